@@ -0,0 +1,647 @@
+#include <benchmark/benchmark.h>
+
+#include <deque>
+#include <sys/syscall.h>
+#include <linux/uinput.h>
+#include "common.hpp"
+#include "input.hpp"
+#include "keyboard/udev.hpp"
+#include "mouse/udev.hpp"
+#include "joypad/udev.hpp"
+#include "mapping.hpp"
+
+using namespace sen;
+
+// Every read/poll/epoll_wait issued by the decoding code is routed through these
+// definitions so that a benchmark can report how many syscalls a poll cycle costs.
+static bool counting = false;
+static uint64_t syscalls = 0;
+
+extern "C" ssize_t read(int fd, void *buffer, size_t size) {
+  if (counting) syscalls++;
+  return syscall(SYS_read, fd, buffer, size);
+}
+
+extern "C" int poll(pollfd *fds, nfds_t count, int timeout) {
+  if (counting) syscalls++;
+  return syscall(SYS_poll, fds, count, timeout);
+}
+
+extern "C" int epoll_wait(int epfd, epoll_event *events, int count, int timeout) {
+  if (counting) syscalls++;
+  return syscall(SYS_epoll_wait, epfd, events, count, timeout);
+}
+
+// A joypad layout shared by all benchmarks: 6 axes, 2 hats and 12 buttons.
+static auto CreateLayout(InputJoypadUdev::Joypad &jp) -> void {
+  jp.vendorID = "0000";
+  jp.productID = "0000";
+  uint id = 0;
+  for (int code = ABS_X; code <= ABS_RZ; ++code) {
+    jp.axes.emplace_back(code, id++);
+    jp.axes.back().info.minimum = -32768;
+    jp.axes.back().info.maximum = +32767;
+  }
+  id = 0;
+  for (int code = ABS_HAT0X; code <= ABS_HAT0Y; ++code) {
+    jp.hats.emplace_back(code, id++);
+    jp.hats.back().info.minimum = -1;
+    jp.hats.back().info.maximum = +1;
+  }
+  id = 0;
+  for (int code = BTN_SOUTH; code <= BTN_THUMBR; ++code) jp.buttons.emplace_back(code, id++);
+}
+
+static auto CreateStream(uint count, uint offset = 0) -> vector<input_event> {
+  vector<input_event> events(count);
+  for (uint i = 0; i < count; ++i) {
+    uint n = offset + i;
+    auto &event = events[i];
+    switch (n % 4) {
+    case 0:
+    case 1: event.type = EV_ABS; event.code = ABS_X + n % 6; event.value = int(n * 7919 % 65536) - 32768; break;
+    case 2: event.type = EV_ABS; event.code = ABS_HAT0X + n % 2; event.value = int(n % 3) - 1; break;
+    case 3: event.type = EV_KEY; event.code = BTN_SOUTH + n % 12; event.value = n & 1; break;
+    }
+  }
+  return events;
+}
+
+// A driver whose joypads are backed by pipes: the read end is handed to the
+// real InputJoypadUdev decoder, the write end is used to inject evdev events.
+struct Pipes : InputDriver {
+  Pipes(Input &super, uint count) : InputDriver(super), joypad(super) {
+    joypad.Initialize();
+    for (uint n = 0; n < count; ++n) {
+      int fds[2];
+      if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0) break;
+      InputJoypadUdev::Joypad jp;
+      jp.fd = fds[0];
+      jp.deviceName = "pipe" + std::to_string(n);
+      CreateLayout(jp);
+      writers.push_back(fds[1]);
+      joypad.AppendJoypad(jp);
+    }
+  }
+
+  ~Pipes() override {
+    for (auto fd : writers) close(fd);
+    joypad.Terminate();
+  }
+
+  auto Driver() -> string override { return "Pipes"; }
+
+  auto Poll(vector<shared_ptr<HID::Device>> &devices) -> void override {
+    joypad.Poll();
+    Publish(devices, joypad.generation, [&](auto &found) { joypad.Devices(found); });
+  }
+
+  auto HasThreaded() -> bool override { return true; }
+  auto SetThreaded(bool threaded) -> bool override { return joypad.SetThreaded(threaded); }
+
+  //threaded mode: waits until the input thread has read and decoded every device
+  auto Settle() -> void {
+    for (auto &jp : joypad.joypads) {
+      while (true) {
+        int bytes = 0;
+        {
+          std::lock_guard<std::mutex> guard(joypad.lock);
+          ioctl(jp.fd, FIONREAD, &bytes);
+        }
+        if (!bytes) break;
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  auto Inject(uint device, uint events) -> void {
+    auto stream = CreateStream(events, offset);
+    offset += events;
+    (void) !write(writers[device], stream.data(), sizeof(input_event) * events);
+  }
+
+  InputJoypadUdev joypad;
+  vector<int> writers;
+  uint offset = 0;
+};
+
+struct PipeInput : Input {
+  explicit PipeInput(uint count) { instance_ = std::make_unique<Pipes>(*this, count); }
+  auto GetPipes() -> Pipes & { return static_cast<Pipes &>(*instance_); }
+};
+
+static auto Measure(benchmark::State &state, const function<void()> &poll) -> void {
+  syscalls = 0;
+  counting = true;
+  poll();
+  counting = false;
+  state.counters["syscalls/poll"] = benchmark::Counter(double(syscalls));
+}
+
+// Reference: the previous strategy, one read() per joypad plus a poll() on the monitor.
+static auto SweepPoll(Pipes &pipes) -> void {
+  pollfd fd{};
+  fd.fd = udev_monitor_get_fd(pipes.joypad.monitor);
+  fd.events = POLLIN;
+  ::poll(&fd, 1, 0);
+  for (auto &jp : pipes.joypad.joypads) pipes.joypad.Read(jp);
+}
+
+static void BM_PollIdle(benchmark::State &state) {
+  PipeInput input(state.range(0));
+  auto &pipes = input.GetPipes();
+  for (auto _ : state) {
+    Measure(state, [&] { pipes.joypad.Poll(); });
+  }
+}
+
+static void BM_PollIdleSweep(benchmark::State &state) {
+  PipeInput input(state.range(0));
+  auto &pipes = input.GetPipes();
+  for (auto _ : state) {
+    Measure(state, [&] { SweepPoll(pipes); });
+  }
+}
+
+static void BM_PollOneActive(benchmark::State &state) {
+  PipeInput input(state.range(0));
+  auto &pipes = input.GetPipes();
+  uint device = 0;
+  for (auto _ : state) {
+    pipes.Inject(device++ % pipes.writers.size(), 4);
+    Measure(state, [&] { pipes.joypad.Poll(); });
+  }
+}
+
+static void BM_PollOneActiveSweep(benchmark::State &state) {
+  PipeInput input(state.range(0));
+  auto &pipes = input.GetPipes();
+  uint device = 0;
+  for (auto _ : state) {
+    pipes.Inject(device++ % pipes.writers.size(), 4);
+    Measure(state, [&] { SweepPoll(pipes); });
+  }
+}
+
+// Full path: every device receives a burst of events, then Input::Poll() reads,
+// decodes, assigns and hands the changes to an OnChangeBatch listener. Only the
+// Poll() is timed; injecting the events is the kernel's side of the work.
+static void BM_Dispatch(benchmark::State &state) {
+  const uint burst = 16;
+  PipeInput input(state.range(0));
+  auto &pipes = input.GetPipes();
+  uint64_t changes = 0;
+  input.OnChangeBatch([&](const InputChange *, size_t count) { changes += count; });
+  vector<shared_ptr<HID::Device>> devices;
+  uint64_t total = 0;
+  double elapsed = 0;
+  for (auto _ : state) {
+    for (uint n = 0; n < pipes.writers.size(); ++n) pipes.Inject(n, burst);
+    syscalls = 0;
+    counting = true;
+    auto start = std::chrono::steady_clock::now();
+    input.Poll(devices);
+    auto stop = std::chrono::steady_clock::now();
+    counting = false;
+    total += syscalls;
+    elapsed += std::chrono::duration<double>(stop - start).count();
+    state.SetIterationTime(std::chrono::duration<double>(stop - start).count());
+  }
+  auto events = double(state.iterations() * pipes.writers.size() * burst);
+  state.SetItemsProcessed(int64_t(events));
+  state.counters["ns/event"] = benchmark::Counter(elapsed * 1e9 / events);
+  state.counters["syscalls/poll"] = benchmark::Counter(double(total), benchmark::Counter::kAvgIterations);
+  state.counters["changes/poll"] = benchmark::Counter(double(changes), benchmark::Counter::kAvgIterations);
+}
+
+// Threaded mode: the input thread reads and decodes each burst, and the timed
+// Poll() only drains the change ring, without a syscall.
+static void BM_DispatchThreaded(benchmark::State &state) {
+  const uint burst = 16;
+  PipeInput input(state.range(0));
+  auto &pipes = input.GetPipes();
+  input.SetThreaded(true);
+  uint64_t changes = 0;
+  input.OnChangeBatch([&](const InputChange *, size_t count) { changes += count; });
+  vector<shared_ptr<HID::Device>> devices;
+  uint64_t total = 0;
+  for (auto _ : state) {
+    for (uint n = 0; n < pipes.writers.size(); ++n) pipes.Inject(n, burst);
+    pipes.Settle();
+    syscalls = 0;
+    counting = true;
+    auto start = std::chrono::steady_clock::now();
+    input.Poll(devices);
+    auto stop = std::chrono::steady_clock::now();
+    counting = false;
+    total += syscalls;
+    state.SetIterationTime(std::chrono::duration<double>(stop - start).count());
+  }
+  input.SetThreaded(false);
+  state.SetItemsProcessed(int64_t(state.iterations() * pipes.writers.size() * burst));
+  state.counters["syscalls/poll"] = benchmark::Counter(double(total), benchmark::Counter::kAvgIterations);
+  state.counters["changes/poll"] = benchmark::Counter(double(changes), benchmark::Counter::kAvgIterations);
+}
+
+// Reference: the previous decoder, which looked every event code up in std::set.
+struct SetDecoder {
+  struct Less {
+    bool operator()(const InputJoypadUdev::JoypadInput &l, const InputJoypadUdev::JoypadInput &r) const {
+      return l.code < r.code;
+    }
+  };
+
+  explicit SetDecoder(const InputJoypadUdev::Joypad &jp) {
+    axes.insert(jp.axes.begin(), jp.axes.end());
+    hats.insert(jp.hats.begin(), jp.hats.end());
+    buttons.insert(jp.buttons.begin(), jp.buttons.end());
+  }
+
+  auto Decode(InputJoypadUdev &joypad, const shared_ptr<HID::Joypad> &hid, const input_event *events, uint count) -> void {
+    for (uint i = 0; i < count; ++i) {
+      int code = events[i].code;
+      int value = events[i].value;
+      if (events[i].type == EV_ABS) {
+        auto axis = axes.find(InputJoypadUdev::JoypadInput{code});
+        if (axis != axes.end()) {
+          value = (value - axis->info.minimum) * 65535 / (axis->info.maximum - axis->info.minimum) - 32767;
+          joypad.Assign({hid.get(), nullptr, HID::Joypad::GroupID::Axis, axis->id, int16_t(sclamp<16>(value)), 0, 0}, 0);
+        } else {
+          auto hat = hats.find(InputJoypadUdev::JoypadInput{code});
+          if (hat != hats.end()) {
+            value = (value - hat->info.minimum) * 65535 / (hat->info.maximum - hat->info.minimum) - 32767;
+            joypad.Assign({hid.get(), nullptr, HID::Joypad::GroupID::Hat, hat->id, int16_t(sclamp<16>(value)), 0, 0}, 0);
+          }
+        }
+      } else if (events[i].type == EV_KEY && code >= BTN_MISC) {
+        auto button = buttons.find(InputJoypadUdev::JoypadInput{code});
+        if (button != buttons.end()) {
+          joypad.Assign({hid.get(), nullptr, HID::Joypad::GroupID::Button, button->id, (bool) value, 0, 0}, 0);
+        }
+      }
+    }
+  }
+
+  set<InputJoypadUdev::JoypadInput, Less> axes;
+  set<InputJoypadUdev::JoypadInput, Less> hats;
+  set<InputJoypadUdev::JoypadInput, Less> buttons;
+};
+
+static void BM_DecodeTable(benchmark::State &state) {
+  Input input;
+  InputJoypadUdev joypad(input);
+  InputJoypadUdev::Joypad jp;
+  CreateLayout(jp);
+  auto &decoded = joypad.AppendJoypad(jp);
+  auto events = CreateStream(4096);
+  for (auto _ : state) {
+    joypad.Decode(decoded, events.data(), events.size());
+  }
+  state.SetItemsProcessed(state.iterations() * events.size());
+}
+
+static void BM_DecodeSet(benchmark::State &state) {
+  Input input;
+  InputJoypadUdev joypad(input);
+  InputJoypadUdev::Joypad jp;
+  CreateLayout(jp);
+  auto &decoded = joypad.AppendJoypad(jp);
+  SetDecoder decoder(decoded);
+  auto events = CreateStream(4096);
+  for (auto _ : state) {
+    decoder.Decode(joypad, decoded.hid, events.data(), events.size());
+  }
+  state.SetItemsProcessed(state.iterations() * events.size());
+}
+
+// Axis normalization alone, over one read() worth of stick and sensor values.
+static auto CreateAbsolutes(uint count) -> vector<InputJoypadUdev::JoypadCode> {
+  vector<InputJoypadUdev::JoypadCode> entries(count);
+  for (uint n = 0; n < count; ++n) entries[n].SetRange(n & 1 ? -32768 : 0, n & 1 ? +32767 : 1023);
+  return entries;
+}
+
+// Reference: the previous per-event division.
+static void BM_NormalizeDivision(benchmark::State &state) {
+  auto entries = CreateAbsolutes(64);
+  auto events = CreateStream(64);
+  int16_t values[64];
+  for (auto _ : state) {
+    for (uint n = 0; n < 64; ++n) {
+      int64_t value = (int64_t(events[n].value) - entries[n].minimum) * 65535 / int32_t(entries[n].range) - 32767;
+      values[n] = int16_t(sclamp<16>(value));
+    }
+    benchmark::DoNotOptimize(values);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * 64);
+}
+
+static void BM_NormalizeBatch(benchmark::State &state) {
+  auto entries = CreateAbsolutes(64);
+  auto events = CreateStream(64);
+  uint32_t offsets[64], highs[64], lows[64];
+  int16_t values[64];
+  for (auto _ : state) {
+    for (uint n = 0; n < 64; ++n) {
+      offsets[n] = entries[n].Offset(events[n].value);
+      highs[n] = entries[n].scaleHigh;
+      lows[n] = entries[n].scaleLow;
+    }
+    InputJoypadUdev::Normalize(offsets, highs, lows, values, 64);
+    benchmark::DoNotOptimize(values);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * 64);
+}
+
+// End to end decode of an axis-only stream, as produced by a gyro or a
+// high-rate stick.
+static void BM_DecodeAbsolute(benchmark::State &state) {
+  Input input;
+  InputJoypadUdev joypad(input);
+  InputJoypadUdev::Joypad jp;
+  CreateLayout(jp);
+  auto &decoded = joypad.AppendJoypad(jp);
+  vector<input_event> events(4096);
+  for (uint n = 0; n < events.size(); ++n) {
+    events[n].type = EV_ABS;
+    events[n].code = ABS_X + n % 6;
+    events[n].value = int(n * 7919 % 65536) - 32768;
+  }
+  for (auto _ : state) {
+    joypad.Decode(decoded, events.data(), events.size());
+  }
+  state.SetItemsProcessed(state.iterations() * events.size());
+}
+
+// Routing one change to its mappings: 4 devices, 256 bound buttons.
+struct Routing {
+  Routing() {
+    for (uint n = 0; n < 4; ++n) {
+      InputJoypadUdev::Joypad jp;
+      CreateLayout(jp);
+      joypad.AppendJoypad(jp);
+    }
+    joypad.Devices(manager->devices);
+    for (uint n = 0; n < 256; ++n) buttons.emplace_back("Button" + std::to_string(n));
+    for (uint n = 0; n < buttons.size(); ++n) {
+      auto &device = manager->devices[n % 4];
+      manager->append(buttons[n]);
+      buttons[n].SetAssignment(manager, device, HID::Joypad::GroupID::Button, n / 4 % device->GetGroup(HID::Joypad::GroupID::Button).size());
+    }
+  }
+
+  auto Change(uint n) -> InputChange {
+    auto &device = manager->devices[n % 4];
+    return {device.get(), device->GetHandle(), HID::Joypad::GroupID::Button, uint16_t(n / 4 % 12), 0, 1, 0};
+  }
+
+  Input input;
+  InputJoypadUdev joypad{input};
+  shared_ptr<InputManager> manager = std::make_shared<InputManager>();
+  std::deque<InputButton> buttons;
+};
+
+// Reference: comparing every mapping against the change.
+static void BM_RouteScan(benchmark::State &state) {
+  Routing routing;
+  uint n = 0, routed = 0;
+  for (auto _ : state) {
+    auto change = routing.Change(n++);
+    for (auto mapping : routing.manager->mappings) {
+      if (mapping->device.get() == change.device && mapping->group_id == change.group && mapping->input_id == change.input) routed++;
+    }
+  }
+  benchmark::DoNotOptimize(routed);
+}
+
+static void BM_RouteTable(benchmark::State &state) {
+  Routing routing;
+  uint n = 0, routed = 0;
+  for (auto _ : state) {
+    auto change = routing.Change(n++);
+    for (auto mapping : routing.manager->routes(change.handle, change.group, change.input)) routed += mapping != nullptr;
+  }
+  benchmark::DoNotOptimize(routed);
+}
+
+// 256 two-button chord hotkeys over 4 devices; every frame samples all of them,
+// and one button toggles every 16th frame.
+static void BM_PollHotkeys(benchmark::State &state) {
+  Routing routing;
+  auto &manager = *routing.manager;
+  for (uint n = 0; n < 256; ++n) {
+    auto &device = manager.devices[n % 4];
+    auto &hotkey = manager.appendHotkey("Hotkey" + std::to_string(n));
+    hotkey.OnPress([] {});
+    hotkey.SetAssignment(nullptr, device, HID::Joypad::GroupID::Button, n % 12);
+    auto key = hotkey.assignment;
+    hotkey.SetAssignment(nullptr, device, HID::Joypad::GroupID::Button, (n / 12 + n + 1) % 12);
+    hotkey.Chord(key);
+  }
+  manager.bind();
+  auto button = manager.devices[0]->GetGroup(HID::Joypad::GroupID::Button).GetInput(0);
+  uint frame = 0;
+  for (auto _ : state) {
+    if (++frame % 16 == 0) button.SetValue(!button.GetValue());
+    manager.pollHotkeys();
+  }
+}
+
+// Keyboard resync: two pressed keys flip between two kernel snapshots of the
+// 768 key bit map.
+static auto KeyStates() -> std::array<InputKeyboardUdev::KeyState, 2> {
+  std::array<InputKeyboardUdev::KeyState, 2> states{};
+  states[0][KEY_LEFTSHIFT / 64] |= 1ull << KEY_LEFTSHIFT % 64;
+  states[1][KEY_A / 64] |= 1ull << KEY_A % 64;
+  states[1][KEY_F12 / 64] |= 1ull << KEY_F12 % 64;
+  return states;
+}
+
+// Reference: testing every key of the snapshot one by one.
+static void BM_KeyDiffScalar(benchmark::State &state) {
+  auto states = KeyStates();
+  uint frame = 0, changed = 0;
+  for (auto _ : state) {
+    auto &last = states[frame & 1], &next = states[++frame & 1];
+    for (uint code = 0; code < KEY_CNT; ++code) {
+      changed += (last[code / 64] >> code % 64 & 1) != (next[code / 64] >> code % 64 & 1);
+    }
+    benchmark::DoNotOptimize(changed);
+  }
+}
+
+static void BM_KeyDiffWords(benchmark::State &state) {
+  Input input;
+  InputKeyboardUdev keyboard(input);
+  keyboard.AppendKeyboard(-1, "");
+  auto states = KeyStates();
+  uint frame = 0;
+  for (auto _ : state) {
+    keyboard.keyboards[0].keys = states[frame++ & 1];
+    keyboard.dirty = (1u << InputKeyboardUdev::Words) - 1;
+    keyboard.Update(0);
+  }
+}
+
+// One frame of an 8 kHz mouse at 1 kHz polling: eight reports are decoded and
+// summed, then handed to the axes as a single change each.
+static void BM_MouseFrame(benchmark::State &state) {
+  Input input;
+  InputMouseUdev mouse(input);
+  mouse.AppendMouse(-1, "");
+  mouse.SetMotionHistory(state.range(0));
+  vector<input_event> events;
+  for (uint n = 0; n < 8; ++n) {
+    for (auto [type, code, value] : {std::tuple{EV_REL, REL_X, 3}, {EV_REL, REL_Y, -1}, {EV_SYN, SYN_REPORT, 0}}) {
+      input_event event{};
+      event.type = type;
+      event.code = code;
+      event.value = value * (n & 1 ? 1 : -1);
+      events.push_back(event);
+    }
+  }
+  for (auto _ : state) {
+    mouse.Decode(mouse.mice[0], events.data(), events.size());
+    mouse.Flush();
+    mouse.historyCount = 0;
+  }
+  state.counters["reports/frame"] = 8;
+}
+
+// 8 devices with bursts of 16 events, and 16 listeners that each want the
+// axes of one device. Arg(0) is the reference: one OnChangeBatch listener
+// offers every change to every listener's own filter; Arg(1) uses Subscribe().
+static void BM_Subscribers(benchmark::State &state) {
+  const uint burst = 16, listeners = 16;
+  PipeInput input(8);
+  auto &pipes = input.GetPipes();
+  vector<shared_ptr<HID::Device>> devices;
+  input.Poll(devices);
+
+  vector<InputFilter> filters;
+  for (uint n = 0; n < listeners; ++n) {
+    filters.push_back({InputFilter::Joypad, devices[n % devices.size()]->GetHandle(), HID::Joypad::GroupID::Axis, 0, 0xffff});
+  }
+  uint64_t delivered = 0, calls = 0;
+  auto listener = [&](const InputChange &) { delivered++; };
+  if (state.range(0)) {
+    for (auto &filter : filters) input.Subscribe(filter, listener);
+  } else {
+    input.OnChangeBatch([&](const InputChange *changes, size_t count) {
+      for (auto &filter : filters) {
+        for (size_t n = 0; n < count; ++n) {
+          calls++;
+          if (changes[n].handle == filter.handle && changes[n].group == filter.group) listener(changes[n]);
+        }
+      }
+    });
+  }
+  for (auto _ : state) {
+    for (uint n = 0; n < pipes.writers.size(); ++n) pipes.Inject(n, burst);
+    auto start = std::chrono::steady_clock::now();
+    input.Poll(devices);
+    auto stop = std::chrono::steady_clock::now();
+    state.SetIterationTime(std::chrono::duration<double>(stop - start).count());
+  }
+  state.counters["filter calls/poll"] = benchmark::Counter(double(calls) / state.iterations());
+  state.counters["deliveries/poll"] = benchmark::Counter(double(delivered) / state.iterations());
+}
+
+// Virtual gamepads for the bring-up benchmarks; needs /dev/uinput and a running
+// udev daemon to tag them as joysticks.
+struct Gamepads {
+  explicit Gamepads(uint count) {
+    for (uint n = 0; n < count; ++n) {
+      int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+      if (fd < 0) return;
+      ioctl(fd, UI_SET_EVBIT, EV_KEY);
+      ioctl(fd, UI_SET_EVBIT, EV_ABS);
+      for (int code = BTN_SOUTH; code <= BTN_THUMBR; ++code) ioctl(fd, UI_SET_KEYBIT, code);
+      for (int code = ABS_X; code <= ABS_RZ; ++code) {
+        ioctl(fd, UI_SET_ABSBIT, code);
+        uinput_abs_setup abs{};
+        abs.code = code;
+        abs.absinfo.minimum = -32768;
+        abs.absinfo.maximum = +32767;
+        ioctl(fd, UI_ABS_SETUP, &abs);
+      }
+      uinput_setup setup{};
+      setup.id.bustype = BUS_USB;
+      setup.id.vendor = 0x1234;
+      setup.id.product = 0x5678;
+      snprintf(setup.name, sizeof(setup.name), "input-bench %u", n);
+      if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0) {
+        close(fd);
+        return;
+      }
+      fds.push_back(fd);
+    }
+  }
+
+  ~Gamepads() {
+    for (auto fd : fds) {
+      ioctl(fd, UI_DEV_DESTROY);
+      close(fd);
+    }
+  }
+
+  vector<int> fds;
+};
+
+// Initialize() until every virtual gamepad has been published to Poll(); the
+// Poll() calls stand in for the frames a game keeps rendering meanwhile.
+static void BM_TimeToReady(benchmark::State &state) {
+  uint count = state.range(0);
+  Gamepads gamepads(count);
+  if (gamepads.fds.size() != count) return state.SkipWithError("requires /dev/uinput");
+  Input input;
+  InputJoypadUdev probe(input);
+  probe.Initialize();
+  for (auto start = probe.Now(); probe.joypads.size() < count && probe.Now() - start < 2'000'000'000;) probe.Poll();
+  if (probe.joypads.size() < count) return state.SkipWithError("gamepads were not tagged by udev");
+  probe.Terminate();
+
+  double stall = 0;
+  for (auto _ : state) {
+    InputJoypadUdev joypad(input);
+    auto start = std::chrono::steady_clock::now();
+    joypad.Initialize();
+    stall = std::max(stall, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    while (joypad.joypads.size() < count) joypad.Poll();
+    state.SetIterationTime(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    joypad.Terminate();
+  }
+  state.counters["initialize_ms"] = benchmark::Counter(stall * 1e3);
+}
+
+static void Devices(benchmark::internal::Benchmark *benchmark) {
+  for (auto count : {1, 4, 16, 64}) benchmark->Arg(count);
+}
+
+BENCHMARK(BM_PollIdle)->Apply(Devices);
+BENCHMARK(BM_PollIdleSweep)->Apply(Devices);
+BENCHMARK(BM_PollOneActive)->Apply(Devices);
+BENCHMARK(BM_PollOneActiveSweep)->Apply(Devices);
+BENCHMARK(BM_Dispatch)->Apply(Devices)->UseManualTime();
+BENCHMARK(BM_DispatchThreaded)->Apply(Devices)->UseManualTime();
+BENCHMARK(BM_TimeToReady)->RangeMultiplier(2)->Range(1, 32)->UseManualTime();
+
+BENCHMARK(BM_DecodeTable);
+BENCHMARK(BM_DecodeSet);
+BENCHMARK(BM_DecodeAbsolute);
+
+BENCHMARK(BM_NormalizeDivision);
+BENCHMARK(BM_NormalizeBatch);
+
+BENCHMARK(BM_RouteScan);
+BENCHMARK(BM_RouteTable);
+BENCHMARK(BM_PollHotkeys);
+
+BENCHMARK(BM_KeyDiffScalar);
+BENCHMARK(BM_KeyDiffWords);
+BENCHMARK(BM_MouseFrame)->Arg(0)->Arg(64);
+BENCHMARK(BM_Subscribers)->Arg(0)->Arg(1)->UseManualTime();
+
+BENCHMARK_MAIN();
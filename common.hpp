@@ -6,6 +6,13 @@
 #include <vector>
 #include <set>
 #include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <unordered_map>
 
 #ifdef INPUT_UDEV
 #include <cerrno>
@@ -13,6 +20,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
 #include <libudev.h>
 #include <linux/types.h>
@@ -59,6 +68,200 @@ inline auto sclamp(const intmax x) -> intmax {
   return (x > m) ? m : (x < -b) ? -b : x;
 }
 
+//lock-free single-producer/single-consumer queue; Size must be a power of two
+template<typename T, uint Size>
+struct Ring {
+  static_assert((Size & (Size - 1)) == 0, "Ring size must be a power of two");
+
+  auto Push(const T &value) -> bool {
+    auto write = write_.load(std::memory_order_relaxed);
+    if (write - read_.load(std::memory_order_acquire) == Size) return false;
+    buffer_[write & (Size - 1)] = value;
+    write_.store(write + 1, std::memory_order_release);
+    return true;
+  }
+
+  auto Pop(T &value) -> bool {
+    auto read = read_.load(std::memory_order_relaxed);
+    if (read == write_.load(std::memory_order_acquire)) return false;
+    value = buffer_[read & (Size - 1)];
+    read_.store(read + 1, std::memory_order_release);
+    return true;
+  }
+
+  auto Free() const -> uint { return Size - uint(Written() - Consumed()); }
+  auto Written() const -> uint64_t { return write_.load(std::memory_order_acquire); }
+  auto Consumed() const -> uint64_t { return read_.load(std::memory_order_acquire); }
+
+ private:
+  alignas(64) std::atomic<uint64_t> write_{0};
+  alignas(64) std::atomic<uint64_t> read_{0};
+  T buffer_[Size];
+};
+
+//lock-free log-linear histogram: every power of two is split into four
+//buckets, so percentiles are reported with at most 25% overestimation
+struct Histogram {
+  enum : uint { SubBits = 2, Buckets = 64 << SubBits };
+
+  auto Record(uint64_t value) -> void {
+    counts_[Bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    auto maximum = maximum_.load(std::memory_order_relaxed);
+    while (value > maximum && !maximum_.compare_exchange_weak(maximum, value, std::memory_order_relaxed));
+  }
+
+  auto Count() const -> uint64_t {
+    uint64_t count = 0;
+    for (auto &bucket : counts_) count += bucket.load(std::memory_order_relaxed);
+    return count;
+  }
+
+  auto Maximum() const -> uint64_t { return maximum_.load(std::memory_order_relaxed); }
+
+  //upper bound of the bucket holding the given quantile (0.0 - 1.0)
+  auto Percentile(double quantile) const -> uint64_t {
+    auto count = Count();
+    if (!count) return 0;
+    auto target = std::max<uint64_t>(1, uint64_t(quantile * count + 0.5));
+    uint64_t seen = 0;
+    for (uint bucket = 0; bucket < Buckets; ++bucket) {
+      seen += counts_[bucket].load(std::memory_order_relaxed);
+      if (seen >= target) return std::min(UpperBound(bucket), Maximum());
+    }
+    return Maximum();
+  }
+
+  static auto Bucket(uint64_t value) -> uint {
+    if (value < (1 << SubBits)) return value;
+    uint exponent = 63 - CountLeadingZeros(value);
+    uint sub = (value >> (exponent - SubBits)) & ((1 << SubBits) - 1);
+    return (exponent - SubBits + 1) << SubBits | sub;
+  }
+
+  static auto UpperBound(uint bucket) -> uint64_t {
+    if (bucket < (1 << SubBits)) return bucket;
+    uint exponent = (bucket >> SubBits) + SubBits - 1;
+    uint64_t mantissa = (1 << SubBits) | (bucket & ((1 << SubBits) - 1));
+    return ((mantissa + 1) << (exponent - SubBits)) - 1;
+  }
+
+ private:
+  static auto CountLeadingZeros(uint64_t value) -> uint {
+    #if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return 63 - index;
+    #else
+    return __builtin_clzll(value);
+    #endif
+  }
+
+  std::atomic<uint64_t> counts_[Buckets]{};
+  std::atomic<uint64_t> maximum_{0};
+};
+
+//identifies an element of a SlotMap; once the element is erased the handle
+//never matches anything stored in the same slot later. generations are drawn
+//from one process-wide sequence, so handles of different registries (joypads,
+//keyboards, ...) never compare equal even when their indices do
+//
+//the backends with a single device (the merged keyboard and mouse) use the
+//reserved indices; slot maps of many devices number theirs after them, so no two
+//live devices share an index and index-addressed tables never collide
+struct Handle {
+  enum : uint32_t { KeyboardIndex, MouseIndex, ReservedIndices };
+
+  uint32_t index = ~0u;
+  uint32_t generation = 0;
+
+  explicit operator bool() const { return index != ~0u; }
+  auto operator==(const Handle &source) const -> bool { return index == source.index && generation == source.generation; }
+  auto operator!=(const Handle &source) const -> bool { return !operator==(source); }
+
+  auto Pack() const -> uint64_t { return uint64_t(generation) << 32 | index; }
+  static auto Unpack(uint64_t value) -> Handle { return {uint32_t(value), uint32_t(value >> 32)}; }
+
+  static auto Next() -> uint32_t {
+    static std::atomic<uint32_t> generation{1};
+    return generation++;
+  }
+};
+
+//O(1) insert, erase and lookup by Handle. elements live in chunks that are never
+//moved, so references stay valid until the element itself is erased; iteration
+//visits the live elements in insertion order. handle indices start at First
+template<typename T, uint ChunkSize = 16, uint32_t First = 0>
+struct SlotMap {
+  struct Slot {
+    std::optional<T> value;
+    uint32_t generation = 0;
+  };
+
+  struct Iterator {
+    auto operator*() const -> T & { return *map->At(*position).value; }
+    auto operator->() const -> T * { return &*map->At(*position).value; }
+    auto operator++() -> Iterator & { return ++position, *this; }
+    auto operator!=(const Iterator &source) const -> bool { return position != source.position; }
+
+    SlotMap *map;
+    vector<uint32_t>::const_iterator position;
+  };
+
+  auto Insert(T value) -> Handle {
+    uint32_t index;
+    if (!free_.empty()) {
+      index = free_.back();
+      free_.pop_back();
+    } else {
+      index = slots_++;
+      if (index % ChunkSize == 0) chunks_.emplace_back(new Slot[ChunkSize]);
+    }
+    auto &slot = At(index);
+    slot.value.emplace(std::move(value));
+    slot.generation = Handle::Next();
+    live_.push_back(index);
+    return {First + index, slot.generation};
+  }
+
+  //erasing keeps the iteration order of the remaining elements, at O(size)
+  auto Erase(Handle handle) -> bool {
+    if (!Find(handle)) return false;
+    uint32_t index = handle.index - First;
+    At(index).value.reset();
+    live_.erase(std::find(live_.begin(), live_.end(), index));
+    free_.push_back(index);
+    return true;
+  }
+
+  auto Find(Handle handle) -> T * {
+    if (handle.index < First || handle.index - First >= slots_) return nullptr;
+    auto &slot = At(handle.index - First);
+    if (slot.generation != handle.generation || !slot.value) return nullptr;
+    return &*slot.value;
+  }
+
+  auto clear() -> void {
+    for (auto index : live_) {
+      At(index).value.reset();
+      free_.push_back(index);
+    }
+    live_.clear();
+  }
+
+  auto size() const -> size_t { return live_.size(); }
+  auto empty() const -> bool { return live_.empty(); }
+  auto begin() -> Iterator { return {this, live_.cbegin()}; }
+  auto end() -> Iterator { return {this, live_.cend()}; }
+
+ private:
+  auto At(uint32_t index) -> Slot & { return chunks_[index / ChunkSize][index % ChunkSize]; }
+
+  vector<unique_ptr<Slot[]>> chunks_;
+  vector<uint32_t> live_;
+  vector<uint32_t> free_;
+  uint32_t slots_ = 0;
+};
+
 namespace Hash {
 struct Hash {
   virtual auto reset() -> void = 0;
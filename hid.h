@@ -2,61 +2,106 @@
 #define HID_H_
 
 #include <string>
+#include <memory>
 #include <utility>
 #include <vector>
 #include <algorithm>
+#include <mutex>
+#include <unordered_set>
+#include "common.hpp"
 
 namespace sen::HID {
 
+//names are shared by every device in the process: a joypad's inputs are named
+//"0", "1", ... and only materialized when asked for
+inline auto Intern(const std::string &name) -> const std::string & {
+  static std::mutex lock;
+  static std::unordered_set<std::string> names;
+  std::lock_guard<std::mutex> guard(lock);
+  return *names.insert(name).first;
+}
+
+class Group;
+class Device;
+
+//a view of one input; the value lives in its device's value block, so an Input
+//is invalidated when inputs are appended to the device
 class Input {
  public:
-  explicit Input(std::string name) : name_(std::move(name)) {}
-
-  auto GetName() const -> const std::string & { return name_; }
-  auto GetValue() const -> int16_t { return value_; }
-  auto SetValue(int16_t value) -> void { value_ = value; }
+  auto GetName() const -> const std::string &;
+  auto GetValue() const -> int16_t { return *value_; }
+  auto SetValue(int16_t value) -> void { *value_ = value; }
 
  private:
-  std::string name_;
-  int16_t value_{0};
+  Input(const Group &group, uint id, int16_t *value) : group_(&group), id_(id), value_(value) {}
+
+  const Group *group_;
+  uint id_;
+  int16_t *value_;
 
   friend class Group;
 };
 
-class Group : public std::vector<Input> {
+//a range of its device's value block
+class Group {
  public:
-  explicit Group(std::string name) : name_(std::move(name)) {}
-  auto GetInput(uint id) -> Input & { return vector::operator[](id); }
-  auto Append(const std::string &name) -> void { emplace_back(name); }
+  auto GetName() const -> const std::string & { return *name_; }
+  auto GetInput(uint id) -> Input { return {*this, id, GetValues() + id}; }
+  auto GetInputName(uint id) const -> const std::string & { return names_.empty() ? Intern(std::to_string(id)) : *names_[id]; }
+  //contiguous values of all inputs in the group
+  auto GetValues() -> int16_t *;
+  auto GetValues() const -> const int16_t *;
+  auto size() const -> uint { return size_; }
+  auto empty() const -> bool { return size_ == 0; }
+
+  auto Append(const std::string &name) -> void;
+  //appends inputs named by their index
+  auto Resize(uint count) -> void;
 
   auto Find(const std::string &name) const -> uint {
-    auto id = std::find_if(begin(), end(), [this, &name](const Input &input) {
-      return input.name_ == name;
+    if (names_.empty()) {
+      if (name.empty() || name.size() > 9 || !std::all_of(name.begin(), name.end(), [](char c) { return c >= '0' && c <= '9'; })) return -1;
+      uint id = std::stoul(name);
+      return id < size_ && std::to_string(id) == name ? id : -1;
+    }
+    auto id = std::find_if(names_.begin(), names_.end(), [&name](const std::string *input) {
+      return *input == name;
     });
 
-    if (id == end()) {
+    if (id == names_.end()) {
       return -1;
     } else {
-      return id - begin();
+      return id - names_.begin();
     }
   }
 
  private:
-  std::string name_;
+  Group(Device &device, const std::string &name) : device_(&device), name_(&Intern(name)) {}
+
+  Device *device_;
+  const std::string *name_;
+  uint offset_{0};
+  uint size_{0};
+  std::vector<const std::string *> names_;  //empty while every input is named by its index
+
   friend class Device;
 };
 
-class Device : public std::vector<Group> {
+//all input values of a device are kept in one block, grouped in group order
+class Device : public std::enable_shared_from_this<Device> {
  public:
   explicit Device(std::string name) : name_(std::move(name)) {}
+  Device(const Device &) = delete;
+  auto operator=(const Device &) -> Device & = delete;
+  virtual ~Device() = default;
 
   auto GetPathID() const -> uint32_t { return static_cast<uint32_t>(id_ >> 32); }
   auto GetVendorID() const -> uint16_t { return static_cast<uint32_t>(id_ >> 16); }
   auto GetProductID() const -> uint16_t { return static_cast<uint32_t>(id_ >> 0); }
 
-  auto SetPathID   (uint32_t path_id   ) -> void { id_ = (uint64_t)path_id     << 32 | GetVendorID() << 16 | GetProductID() << 0; }
-  auto SetVendorID (uint16_t vendor_id ) -> void { id_ = (uint64_t)GetPathID() << 32 | vendor_id     << 16 | GetProductID() << 0; }
-  auto SetProductID(uint16_t product_id) -> void { id_ = (uint64_t)GetPathID() << 32 | GetVendorID() << 16 | product_id     << 0; }
+  auto SetPathID   (uint32_t path_id   ) -> void { SetID((uint64_t)path_id     << 32 | GetVendorID() << 16 | GetProductID() << 0); }
+  auto SetVendorID (uint16_t vendor_id ) -> void { SetID((uint64_t)GetPathID() << 32 | vendor_id     << 16 | GetProductID() << 0); }
+  auto SetProductID(uint16_t product_id) -> void { SetID((uint64_t)GetPathID() << 32 | GetVendorID() << 16 | product_id     << 0); }
 
   virtual auto IsNull() const -> bool { return false; }
   virtual auto IsKeyboard() const -> bool { return false; }
@@ -65,28 +110,77 @@ class Device : public std::vector<Group> {
 
   auto GetName() const -> const std::string & { return name_; }
   auto GetID() const -> uint64_t { return id_; }
-  auto SetID(uint64_t id) -> void { id_ = id; }
-  auto GetGroup(uint id) -> Group & { return vector::operator[](id); }
-  auto Append(const std::string &name) -> void { emplace_back(name); }
-  auto AppendList(const std::vector<std::string> &names) -> void { for (auto & name : names) emplace_back(name); }
+  auto SetID(uint64_t id) -> void {
+    id_ = id;
+    IDChanges()++;
+  }
+  //counts the ID changes of every device in the process, so registries keyed by
+  //ID know when they must be rebuilt
+  static auto IDChanges() -> std::atomic<uint64_t> & {
+    static std::atomic<uint64_t> changes{0};
+    return changes;
+  }
+  //assigned by the driver's device registry, see Input::Rumble() and Input::Statistics()
+  auto GetHandle() const -> Handle { return handle_; }
+  auto SetHandle(Handle handle) -> void { handle_ = handle; }
+  auto GetGroup(uint id) -> Group & { return groups_[id]; }
+  auto Append(const std::string &name) -> void { groups_.push_back(Group(*this, name)); }
+  auto AppendList(const std::vector<std::string> &names) -> void {
+    groups_.reserve(groups_.size() + names.size());
+    for (auto & name : names) Append(name);
+  }
+
+  auto begin() -> std::vector<Group>::iterator { return groups_.begin(); }
+  auto end() -> std::vector<Group>::iterator { return groups_.end(); }
+  auto size() const -> uint { return groups_.size(); }
 
   auto Find(const std::string &name) -> uint {
-    auto id = std::find_if(begin(), end(), [this, &name](const Group &group) {
-      return group.name_ == name;
+    auto id = std::find_if(groups_.begin(), groups_.end(), [&name](const Group &group) {
+      return group.GetName() == name;
     });
 
-    if (id == end()) {
+    if (id == groups_.end()) {
       return -1;
     } else {
-      return id - begin();
+      return id - groups_.begin();
     }
   }
 
  private:
+  //makes room for count inputs at the end of group, moving the groups after it
+  auto Grow(Group &group, uint count) -> void {
+    values_.insert(values_.begin() + group.offset_ + group.size_, count, 0);
+    group.size_ += count;
+    for (auto next = &group + 1; next != groups_.data() + groups_.size(); ++next) next->offset_ += count;
+  }
+
   std::string name_;
   uint64_t id_{0};
+  Handle handle_;
+  std::vector<Group> groups_;
+  std::vector<int16_t> values_;
+
+  friend class Group;
 };
 
+inline auto Input::GetName() const -> const std::string & { return group_->GetInputName(id_); }
+
+inline auto Group::GetValues() -> int16_t * { return device_->values_.data() + offset_; }
+inline auto Group::GetValues() const -> const int16_t * { return device_->values_.data() + offset_; }
+
+inline auto Group::Append(const std::string &name) -> void {
+  if (names_.empty() && name == std::to_string(size_)) return device_->Grow(*this, 1);
+  for (uint id = names_.size(); id < size_; ++id) names_.push_back(&GetInputName(id));
+  names_.push_back(&Intern(name));
+  device_->Grow(*this, 1);
+}
+
+inline auto Group::Resize(uint count) -> void {
+  if (count <= size_) return;
+  for (uint id = size_; id < count && !names_.empty(); ++id) names_.push_back(&Intern(std::to_string(id)));
+  device_->Grow(*this, count - size_);
+}
+
 class NullDevice : public Device {
  public:
   enum : uint16_t { GenericVendorID = 0x0000, GenericProductID = 0x0000 };
@@ -96,6 +190,7 @@ class NullDevice : public Device {
 };
 
 class Keyboard : public Device {
+ public:
   enum : uint16_t { GenericVendorID = 0x0000, GenericProductID = 0x0001 };
   enum GroupID : uint { Button };
 
@@ -106,6 +201,7 @@ class Keyboard : public Device {
 };
 
 class Mouse : public Device {
+ public:
   enum : uint16_t { GenericVendorID = 0x0000, GenericProductID = 0x0002 };
   enum GroupID : uint { Axis, Button };
 
@@ -0,0 +1,117 @@
+#include <chrono>
+
+#include "mapping.hpp"
+#include "hid.h"
+
+namespace sen {
+
+//assigns each distinct bound input one bit, and builds every hotkey's chord mask
+//and sequence steps from them; unbound hotkeys stay disarmed
+auto InputManager::compileHotkeys() -> void {
+  hotkey_inputs.clear();
+  auto bit = [&](const InputMapping &key) -> uint32_t {
+    for (uint32_t n = 0; n < hotkey_inputs.size(); ++n) {
+      auto &input = hotkey_inputs[n];
+      if (input.device == key.device && input.group_id == key.group_id
+          && input.input_id == key.input_id && input.qualifier == key.qualifier) return n;
+    }
+    hotkey_inputs.push_back(key);
+    return hotkey_inputs.size() - 1;
+  };
+
+  vector<vector<uint32_t>> chords(hotkeys.size());
+  uint index = 0;
+  for (auto &hotkey : hotkeys) {
+    auto &chord = chords[index++];
+    hotkey.steps.clear();
+    hotkey.armed = hotkey.device != nullptr;
+    for (auto &key : hotkey.chord) hotkey.armed &= key.device != nullptr;
+    for (auto &step : hotkey.sequence) hotkey.armed &= step.device != nullptr;
+    if (!hotkey.armed) continue;
+    chord.push_back(bit(hotkey));
+    for (auto &key : hotkey.chord) chord.push_back(bit(key));
+    for (auto &step : hotkey.sequence) hotkey.steps.push_back(bit(step));
+  }
+
+  hotkey_words = (hotkey_inputs.size() + 63) / 64;
+  hotkey_masks.assign(hotkeys.size() * hotkey_words, 0);
+  for (uint n = 0; n < hotkeys.size(); ++n) {
+    for (auto key : chords[n]) hotkey_masks[n * hotkey_words + key / 64] |= 1ull << key % 64;
+  }
+  hotkey_pressed.assign(hotkey_words, 0);
+  hotkey_sampled.assign(hotkey_words, 0);
+  hotkey_rising.assign(hotkey_words, 0);
+
+  hotkeys_dirty = false;
+}
+
+auto InputManager::pollHotkeys() -> void {
+  pollHotkeys(std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+//samples every hotkey input once, then evaluates all hotkeys against the pressed
+//set; when nothing was pressed or released since the last call, no hotkey can change
+auto InputManager::pollHotkeys(uint64_t now) -> void {
+  if (hotkeys_dirty) compileHotkeys();
+
+  auto words = hotkey_words;
+  std::fill(hotkey_sampled.begin(), hotkey_sampled.end(), 0);
+  for (uint32_t n = 0; n < hotkey_inputs.size(); ++n) {
+    if (hotkey_inputs[n].Value()) hotkey_sampled[n / 64] |= 1ull << n % 64;
+  }
+  bool changed = false, rising = false;
+  for (uint w = 0; w < words; ++w) {
+    hotkey_rising[w] = hotkey_sampled[w] & ~hotkey_pressed[w];
+    changed |= hotkey_sampled[w] != hotkey_pressed[w];
+    rising |= hotkey_rising[w] != 0;
+  }
+  if (!changed) return;
+  std::swap(hotkey_pressed, hotkey_sampled);
+
+  auto isRising = [&](uint32_t bit) { return hotkey_rising[bit / 64] >> bit % 64 & 1; };
+
+  uint n = 0;
+  for (auto &hotkey : hotkeys) {
+    auto mask = &hotkey_masks[n++ * words];
+    if (!hotkey.armed) continue;
+
+    if (!hotkey.steps.empty() && rising && !hotkey.state) {
+      if (hotkey.step && now > hotkey.deadline) hotkey.step = 0;
+      bool stray = false;
+      if (hotkey.step < hotkey.steps.size()) {
+        auto expected = hotkey.steps[hotkey.step];
+        for (uint w = 0; w < words; ++w) {
+          auto other = hotkey_rising[w];
+          if (expected / 64 == w) other &= ~(1ull << expected % 64);
+          stray |= other != 0;
+        }
+        if (isRising(expected) && !stray) {
+          hotkey.step++;
+          hotkey.deadline = now + hotkey.timeout;
+        }
+      } else {
+        for (uint w = 0; w < words; ++w) stray |= (hotkey_rising[w] & ~mask[w]) != 0;
+      }
+      if (stray) {
+        //a wrong input restarts the sequence, and may itself begin it
+        hotkey.step = isRising(hotkey.steps[0]) ? 1 : 0;
+        hotkey.deadline = now + hotkey.timeout;
+      }
+    }
+
+    bool held = hotkey.step == hotkey.steps.size() && (hotkey.steps.empty() || now <= hotkey.deadline || hotkey.state);
+    for (uint w = 0; w < words && held; ++w) held = (hotkey_pressed[w] & mask[w]) == mask[w];
+
+    if (held && !hotkey.state) {
+      hotkey.state = 1;
+      if (hotkey.press_callback) hotkey.press_callback();
+    } else if (!held && hotkey.state) {
+      hotkey.state = 0;
+      hotkey.step = 0;
+      if (hotkey.release_callback) hotkey.release_callback();
+    }
+  }
+}
+
+}
@@ -0,0 +1,280 @@
+#ifndef HUB_HPP_
+#define HUB_HPP_
+
+#include <map>
+#include <mutex>
+
+#include "input.hpp"
+#include "hid.h"
+
+namespace sen {
+
+//one device driver per process, shared by every Input attached to it: the driver's
+//contexts, fds and decoding exist once, and each poll's changes are fanned out to
+//every attached Input, which receives them on its own next Poll()
+//
+//device settings (threaded, coalesced, motion history, acquire, record) belong to
+//the hub: the first Input's are applied, then the last Input to change one wins;
+//the HID devices are shared as well, so Inputs polled from different threads must
+//not read them while another polls
+//
+//an Input that does not poll keeps at most Backlog changes queued: past that, the
+//older ones are dropped, along with the removed devices that only they referenced
+struct InputHub {
+  static constexpr size_t Backlog = 65536;
+
+  using Factory = function<unique_ptr<InputDriver>(Input &)>;
+
+  //returns the hub named name, creating its driver with factory if no Input is attached
+  static auto Attach(const string &name, Input &client, const Factory &factory) -> shared_ptr<InputHub> {
+    auto &registry = Registry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    auto hub = registry.hubs[name].lock();
+    if (!hub) {
+      hub = std::make_shared<InputHub>();
+      hub->host.Install(factory(hub->host));
+      hub->host.OnChangeBatch([hub = hub.get()](const InputChange *changes, size_t count) { hub->FanOut(changes, count); });
+      registry.hubs[name] = hub;
+    }
+    std::lock_guard<std::mutex> hubGuard(hub->lock);
+    Client entry;
+    entry.input = &client;
+    entry.round = hub->round;
+    hub->clients.push_back(std::move(entry));
+    return hub;
+  }
+
+  auto Detach(Input &client) -> void {
+    std::lock_guard<std::mutex> guard(lock);
+    clients.erase(std::remove_if(clients.begin(), clients.end(), [&](auto &entry) { return entry.input == &client; }), clients.end());
+  }
+
+  //polls the driver, unless another Input did since client's last poll, then
+  //delivers the changes queued for client since that poll. Inputs polled in turn
+  //share one driver poll per round instead of one each, at the cost of an Input
+  //polled right after another seeing no newer events than it did. the changes are
+  //delivered outside the hub lock, so callbacks may use the hub. returns true if
+  //devices was reassigned
+  auto Poll(Input &client, vector<shared_ptr<HID::Device>> &devices) -> bool {
+    vector<InputChange> changes;
+    vector<shared_ptr<HID::Device>> retained;
+    bool reassigned = false;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      auto self = std::find_if(clients.begin(), clients.end(), [&](auto &entry) { return entry.input == &client; });
+      if (self == clients.end()) {
+        devices.clear();
+        return false;
+      }
+      if (self->round == round) {
+        round++;
+        host.Poll(polled);
+        if (polled != devices_) {
+          //removed devices stay alive until every queued change for them is delivered
+          for (auto &other : clients) {
+            if (!other.pending.empty()) other.retained.insert(other.retained.end(), devices_.begin(), devices_.end());
+          }
+          devices_ = polled;
+        }
+      }
+      self->round = round;
+      changes.swap(self->pending);
+      retained.swap(self->retained);
+      reassigned = devices != devices_;
+      if (reassigned) devices = devices_;
+    }
+    for (auto &change : changes) {
+      client.DoChange(*change.device, change.group, change.input, change.old_value, change.new_value, change.timestamp);
+    }
+    return reassigned;
+  }
+
+  //runs configure on the shared Input for the first attached Input, until it succeeds
+  template<typename F> auto Configure(F &&configure) -> bool {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!configured) configured = configure(host);
+    return configured && host.Ready();
+  }
+
+  //runs f on the shared Input under the hub lock
+  template<typename F> auto Apply(F &&f) {
+    std::lock_guard<std::mutex> guard(lock);
+    return f(host);
+  }
+
+  //runs f on the shared Input without the hub lock, for the calls the driver
+  //serializes itself (Rumble, Statistics), so that they never wait for a poll
+  template<typename F> auto Forward(F &&f) {
+    return f(host);
+  }
+
+ private:
+  struct Host : Input {
+    auto Install(unique_ptr<InputDriver> driver) -> void { instance_ = std::move(driver); }
+  };
+
+  struct Client {
+    Input *input = nullptr;
+    uint round = 0;  //of the last driver poll delivered to input
+    vector<InputChange> pending;
+    vector<shared_ptr<HID::Device>> retained;
+  };
+
+  struct Hubs {
+    std::mutex lock;
+    std::map<string, std::weak_ptr<InputHub>> hubs;
+  };
+
+  static auto Registry() -> Hubs & {
+    static Hubs registry;
+    return registry;
+  }
+
+  auto FanOut(const InputChange *changes, size_t count) -> void {
+    for (auto &client : clients) {
+      client.pending.insert(client.pending.end(), changes, changes + count);
+      if (client.pending.size() > Backlog) Trim(client);
+    }
+  }
+
+  //drops the older half of the changes, and the retained devices that no remaining
+  //change refers to; halving keeps the trims rare for an Input that never polls
+  auto Trim(Client &client) -> void {
+    client.pending.erase(client.pending.begin(), client.pending.end() - Backlog / 2);
+    vector<HID::Device *> referenced;
+    for (auto &change : client.pending) referenced.push_back(change.device);
+    std::sort(referenced.begin(), referenced.end());
+    auto &retained = client.retained;
+    std::sort(retained.begin(), retained.end());
+    retained.erase(std::unique(retained.begin(), retained.end()), retained.end());
+    retained.erase(std::remove_if(retained.begin(), retained.end(), [&](auto &device) {
+      return !std::binary_search(referenced.begin(), referenced.end(), device.get());
+    }), retained.end());
+  }
+
+  std::mutex lock;
+  bool configured = false;
+  Host host;
+  uint round = 0;  //incremented by every driver poll
+  vector<Client> clients;
+  vector<shared_ptr<HID::Device>> polled;
+  vector<shared_ptr<HID::Device>> devices_;
+};
+
+//the driver of an Input attached to a hub: every call is forwarded to the hub's
+//driver, and the hub is attached once a context is set
+struct InputShared : InputDriver {
+  InputShared(Input &super, string name, InputHub::Factory factory)
+      : InputDriver(super), name(std::move(name)), factory(std::move(factory)) {}
+  ~InputShared() override { Terminate(); }
+
+  auto Create() -> bool override { return Initialize(); }
+
+  auto Driver() -> string override { return name; }
+  auto Ready() -> bool override { return hub && hub->Apply([](Input &host) { return host.Ready(); }); }
+
+  auto HasContext() -> bool override { return true; }
+
+  auto SetContext(uintptr_t context) -> bool override { return Initialize(); }
+
+  auto HasThreaded() -> bool override { return true; }
+
+  auto SetThreaded(bool threaded) -> bool override {
+    if (!hub) return true;  //applied by Initialize()
+    return hub->Apply([&](Input &host) { return host.SetThreaded(threaded); });
+  }
+
+  auto HasCoalesced() -> bool override { return true; }
+
+  auto SetCoalesced(bool coalesced) -> bool override {
+    if (!hub) return true;
+    return hub->Apply([&](Input &host) { return host.SetCoalesced(coalesced); });
+  }
+
+  auto HasMotionHistory() -> bool override { return true; }
+
+  auto SetMotionHistory(uint samples) -> bool override {
+    if (!hub) return true;
+    return hub->Apply([&](Input &host) { return host.SetMotionHistory(samples); });
+  }
+
+  //the reports of the hub's last poll, which may have been made for another Input
+  auto Motion(vector<InputMotion> &samples) -> void override {
+    if (!hub) return samples.clear();
+    hub->Apply([&](Input &host) { host.Motion(samples); });
+  }
+
+  auto Acquired() -> bool override { return hub && hub->Apply([](Input &host) { return host.Acquired(); }); }
+  auto Acquire() -> bool override { return hub && hub->Apply([](Input &host) { return host.Acquire(); }); }
+  auto Release() -> bool override { return hub && hub->Apply([](Input &host) { return host.Release(); }); }
+
+  auto Poll(vector<shared_ptr<HID::Device>> &devices) -> void override {
+    if (!hub) return devices.clear();
+    //moves the generation with the device set, as Publish() would
+    if (hub->Poll(super_, devices)) generation_++;
+  }
+
+  //rumble commands and statistics do not wait for another Input's poll
+  auto Rumble(uint64_t id, uint16_t strong, uint16_t weak, uint16_t duration) -> bool override {
+    return hub && hub->Forward([&](Input &host) { return host.Rumble(id, strong, weak, duration); });
+  }
+
+  auto Rumble(Handle handle, uint16_t strong, uint16_t weak, uint16_t duration) -> bool override {
+    return hub && hub->Forward([&](Input &host) { return host.Rumble(handle, strong, weak, duration); });
+  }
+
+  auto Statistics(uint64_t id) -> InputStatistics override {
+    if (!hub) return {};
+    return hub->Forward([&](Input &host) { return host.Statistics(id); });
+  }
+
+  auto Statistics(Handle handle) -> InputStatistics override {
+    if (!hub) return {};
+    return hub->Forward([&](Input &host) { return host.Statistics(handle); });
+  }
+
+  auto Resync() -> void override {
+    if (hub) hub->Apply([](Input &host) { host.Resync(); });
+  }
+
+  auto Record(const string &path) -> bool override {
+    return hub && hub->Apply([&](Input &host) { return host.Record(path); });
+  }
+
+  //only used by the Input that creates the hub, before its initial device scan
+  auto Cache(const string &path) -> bool override {
+    cache = path;
+    return true;
+  }
+
+ private:
+  auto Initialize() -> bool {
+    Terminate();
+    if (!self.context_) return false;
+    hub = InputHub::Attach(name, super_, factory);
+    //an Input joining a running hub takes its settings as they are
+    return hub->Configure([&](Input &host) {
+      if (!cache.empty()) host.Cache(cache);
+      if (host.HasContext() && !host.SetContext(self.context_)) return false;
+      if (!host.SetThreaded(self.threaded_)) return false;
+      if (!host.SetCoalesced(self.coalesced_)) return false;
+      if (!host.SetMotionHistory(self.motion_history_)) return false;
+      return true;
+    });
+  }
+
+  auto Terminate() -> void {
+    if (hub) hub->Detach(super_);
+    hub.reset();
+  }
+
+  InputShared &self = *this;
+  string name;
+  InputHub::Factory factory;
+  string cache;
+  shared_ptr<InputHub> hub;
+};
+
+}
+
+#endif //HUB_HPP_
@@ -1,5 +1,7 @@
 #include "input.hpp"
+#include "hid.h"
 #include <utility>
+#include <chrono>
 
 #if defined(INPUT_CARBON)
 #include <ruby/input/carbon.cpp>
@@ -14,7 +16,10 @@
 #endif
 
 #if defined(INPUT_UDEV)
+#include "hub.hpp"
 #include "udev.hpp"
+#include "replay.hpp"
+#include "synthetic.hpp"
 #endif
 
 #if defined(INPUT_WINDOWS)
@@ -34,6 +39,27 @@ auto Input::SetContext(uintptr_t context) -> bool {
   return true;
 }
 
+auto Input::SetThreaded(bool threaded) -> bool {
+  if (instance_->threaded_ == threaded) return true;
+  if (!instance_->HasThreaded()) return false;
+  if (!instance_->SetThreaded(instance_->threaded_ = threaded)) return false;
+  return true;
+}
+
+auto Input::SetCoalesced(bool coalesced) -> bool {
+  if (instance_->coalesced_ == coalesced) return true;
+  if (!instance_->HasCoalesced()) return false;
+  if (!instance_->SetCoalesced(instance_->coalesced_ = coalesced)) return false;
+  return true;
+}
+
+auto Input::SetMotionHistory(uint samples) -> bool {
+  if (instance_->motion_history_ == samples) return true;
+  if (!instance_->HasMotionHistory()) return false;
+  if (!instance_->SetMotionHistory(instance_->motion_history_ = samples)) return false;
+  return true;
+}
+
 auto Input::Acquired() -> bool {
   return instance_->Acquired();
 }
@@ -47,11 +73,72 @@ auto Input::Release() -> bool {
 }
 
 auto Input::Poll() -> vector<std::shared_ptr<HID::Device>> {
-  return instance_->Poll();
+  vector<shared_ptr<HID::Device>> devices;
+  Poll(devices);
+  return devices;
+}
+
+//devices is only reassigned when the device set changed, so a container that
+//is reused across calls makes steady-state polling allocation free
+auto Input::Poll(vector<shared_ptr<HID::Device>> &devices) -> void {
+  timestamp_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  auto generation = instance_->generation_;
+  instance_->Poll(devices);
+  //a new device set may reuse the handle index of a removed device
+  if (instance_->generation_ != generation) {
+    routes_.clear();
+    route_collisions_.clear();
+  }
+  if (!changes_.empty()) {
+    if (change_batch_) change_batch_(changes_.data(), changes_.size());
+    if (!subscribers_.empty()) Dispatch();
+    changes_.clear();
+    retained_.clear();
+  }
 }
 
 auto Input::Rumble(uint64_t id, bool enable) -> bool {
-  return instance_->Rumble(id, enable);
+  return Rumble(id, enable ? 65535 : 0, enable ? 65535 : 0);
+}
+
+auto Input::Rumble(Handle handle, bool enable) -> bool {
+  return Rumble(handle, enable ? 65535 : 0, enable ? 65535 : 0);
+}
+
+auto Input::Rumble(uint64_t id, uint16_t strong, uint16_t weak, uint duration) -> bool {
+  return instance_->Rumble(id, strong, weak, std::min(duration, 65535u));
+}
+
+auto Input::Rumble(Handle handle, uint16_t strong, uint16_t weak, uint duration) -> bool {
+  return instance_->Rumble(handle, strong, weak, std::min(duration, 65535u));
+}
+
+auto Input::Statistics(uint64_t id) -> InputStatistics {
+  return instance_->Statistics(id);
+}
+
+auto Input::Statistics(Handle handle) -> InputStatistics {
+  return instance_->Statistics(handle);
+}
+
+//captures the raw device stream into path; an empty path stops recording
+auto Input::Record(const string &path) -> bool {
+  return instance_->Record(path);
+}
+
+auto Input::Cache(const string &path) -> bool {
+  return instance_->Cache(path);
+}
+
+//only supported by the Replay driver
+auto Input::Replay(const string &path, bool realtime) -> bool {
+  return instance_->Replay(path, realtime);
+}
+
+//only supported by the Synthetic driver; replaces the simulated joypads
+auto Input::Simulate(const vector<InputSimulation> &devices) -> bool {
+  return instance_->Simulate(devices);
 }
 
 auto Input::OnChange(const function<void(shared_ptr<sen::HID::Device>,
@@ -62,8 +149,94 @@ auto Input::OnChange(const function<void(shared_ptr<sen::HID::Device>,
   change = on_change;
 }
 
-auto Input::DoChange(shared_ptr<HID::Device> device, uint group, uint input, int16_t old_value, int16_t new_value) -> void {
-  if (change) change(std::move(device), group, input, old_value, new_value);
+auto Input::OnChangeBatch(const function<void(const InputChange *, size_t)> &on_change_batch) -> void {
+  change_batch_ = on_change_batch;
+  changes_.clear();
+  retained_.clear();
+}
+
+auto Input::Subscribe(const InputFilter &filter, const function<void(const InputChange &)> &listener) -> uint {
+  subscribers_.push_back({++subscriber_, filter, listener});
+  routes_.clear();
+  route_collisions_.clear();
+  return subscriber_;
+}
+
+auto Input::Unsubscribe(uint id) -> bool {
+  for (uint n = 0; n < subscribers_.size(); ++n) {
+    if (subscribers_[n].id != id) continue;
+    subscribers_.erase(subscribers_.begin() + n);
+    routes_.clear();
+    route_collisions_.clear();
+    return true;
+  }
+  return false;
+}
+
+//the device class and handle filters are applied once per device when its route
+//is built, so an event only visits the subscribers of its own device and group
+auto Input::Find(HID::Device &device) -> Route & {
+  auto handle = device.GetHandle();
+  if (handle.index < routes_.size() && routes_[handle.index].handle == handle) return routes_[handle.index];
+  for (auto &item : route_collisions_) {
+    if (item.handle == handle) return item;
+  }
+
+  uint classes = device.IsKeyboard() ? uint(InputFilter::Keyboard) : device.IsMouse() ? uint(InputFilter::Mouse)
+               : device.IsJoypad() ? uint(InputFilter::Joypad) : 0u;
+  uint groups = device.size();
+  if (handle && handle.index >= routes_.size()) routes_.resize(handle.index + 1);
+  auto &route = handle && !routes_[handle.index].handle ? routes_[handle.index] : route_collisions_.emplace_back();
+  route.handle = handle;
+  route.offsets.assign(groups + 1, 0);
+  auto matches = [&](const InputFilter &filter) {
+    return filter.classes & classes && (!filter.handle || filter.handle == handle);
+  };
+  for (auto &subscriber : subscribers_) {
+    if (!matches(subscriber.filter)) continue;
+    for (uint group = 0; group < groups; ++group) {
+      if (subscriber.filter.group == ~0u || subscriber.filter.group == group) route.offsets[group + 1]++;
+    }
+  }
+  for (uint group = 0; group < groups; ++group) route.offsets[group + 1] += route.offsets[group];
+  route.targets.resize(route.offsets[groups]);
+  auto next = route.offsets;
+  for (uint32_t n = 0; n < subscribers_.size(); ++n) {
+    auto &filter = subscribers_[n].filter;
+    if (!matches(filter)) continue;
+    for (uint group = 0; group < groups; ++group) {
+      if (filter.group == ~0u || filter.group == group) route.targets[next[group]++] = n;
+    }
+  }
+  return route;
+}
+
+auto Input::Dispatch() -> void {
+  for (auto &change : changes_) {
+    auto &route = Find(*change.device);
+    if (change.group + 1u >= route.offsets.size()) continue;
+    for (auto n = route.offsets[change.group]; n < route.offsets[change.group + 1]; ++n) {
+      auto &subscriber = subscribers_[route.targets[n]];
+      if (change.input < subscriber.filter.first || change.input > subscriber.filter.last) continue;
+      subscriber.listener(change);
+    }
+  }
+}
+
+//the batch path only records the change, holding one reference per device so a
+//device removed later in the same poll outlives its changes; a shared_ptr is
+//materialized per event solely for the per-event callback
+auto Input::DoChange(HID::Device &device, uint group, uint input, int16_t old_value, int16_t new_value, uint64_t timestamp) -> void {
+  if (change_batch_ || !subscribers_.empty()) {
+    if (retained_.empty() || retained_.back().get() != &device) {
+      auto held = std::find_if(retained_.begin(), retained_.end(), [&](auto &entry) { return entry.get() == &device; });
+      if (held == retained_.end()) {
+        if (auto shared = device.weak_from_this().lock()) retained_.push_back(std::move(shared));
+      }
+    }
+    changes_.push_back({&device, device.GetHandle(), uint16_t(group), uint16_t(input), old_value, new_value, timestamp ? timestamp : timestamp_});
+  }
+  if (change) change(device.shared_from_this(), group, input, old_value, new_value);
 }
 
 auto Input::Create(string driver) -> bool {
@@ -83,7 +256,14 @@ auto Input::Create(string driver) -> bool {
   #endif
 
   #if defined(INPUT_UDEV)
-  if (driver == "udev") self.instance_ = std::make_unique<InputUdev>(*this);
+  //every udev Input in the process shares one set of contexts and device fds
+  if (driver == "udev") {
+    self.instance_ = std::make_unique<InputShared>(*this, "udev", [](Input &host) -> unique_ptr<InputDriver> {
+      return std::make_unique<InputUdev>(host);
+    });
+  }
+  if (driver == "Replay") self.instance_ = std::make_unique<InputReplay>(*this);
+  if (driver == "Synthetic") self.instance_ = std::make_unique<InputSynthetic>(*this);
   #endif
 
   #if defined(INPUT_SDL)
@@ -115,6 +295,8 @@ auto Input::HasDrivers() -> vector<string> {
 
       #if defined(INPUT_UDEV)
       "udev",
+      "Replay",
+      "Synthetic",
       #endif
 
       #if defined(INPUT_SDL)
@@ -8,6 +8,58 @@ namespace HID {
 struct Device;
 }
 
+//one changed input, as delivered to Input::OnChangeBatch(); device is only
+//valid for the duration of the callback
+struct InputChange {
+  HID::Device *device;
+  Handle handle;
+  uint16_t group;
+  uint16_t input;
+  int16_t old_value;
+  int16_t new_value;
+  uint64_t timestamp;  //monotonic nanoseconds: the kernel event time, or the time of Poll() when unavailable
+};
+
+//which changes reach an Input::Subscribe() listener; the defaults match everything
+struct InputFilter {
+  enum Class : uint { Keyboard = 1 << 0, Mouse = 1 << 1, Joypad = 1 << 2, Any = ~0u };
+  uint classes = Any;   //a mask of Class
+  Handle handle;        //a null handle matches every device
+  uint group = ~0u;     //~0u matches every group
+  uint16_t first = 0;   //inclusive input range within the group
+  uint16_t last = 0xffff;
+};
+
+//latency distribution in nanoseconds
+struct InputLatency {
+  uint64_t count;
+  uint64_t p50;
+  uint64_t p99;
+  uint64_t maximum;
+};
+
+struct InputStatistics {
+  InputLatency kernel;  //kernel event timestamp -> DoChange dispatch
+  InputLatency read;    //read() -> DoChange dispatch
+  uint64_t drops;       //kernel buffer overflows (SYN_DROPPED) recovered by a resync
+};
+
+//relative mouse motion of one hardware report (SYN_REPORT), see Input::Motion()
+struct InputMotion {
+  int32_t x;
+  int32_t y;
+  int32_t wheel;
+  uint64_t timestamp;  //monotonic nanoseconds, the kernel event time
+};
+
+//one simulated joypad of the Synthetic driver
+struct InputSimulation {
+  uint axes = 6;
+  uint hats = 2;
+  uint buttons = 12;
+  uint rate = 1000;  //reports per second, typically 125 - 8000
+};
+
 struct Input;
 struct InputDriver {
   explicit InputDriver(Input &super) : super_(super) {}
@@ -21,15 +73,53 @@ struct InputDriver {
 
   virtual auto SetContext(uintptr_t context) -> bool { return true; }
 
+  virtual auto HasThreaded() -> bool { return false; }
+
+  virtual auto SetThreaded(bool threaded) -> bool { return true; }
+
+  virtual auto HasCoalesced() -> bool { return false; }
+
+  virtual auto SetCoalesced(bool coalesced) -> bool { return true; }
+
+  virtual auto HasMotionHistory() -> bool { return false; }
+
+  virtual auto SetMotionHistory(uint samples) -> bool { return true; }
+
+  virtual auto Motion(vector<InputMotion> &samples) -> void { samples.clear(); }
+
   virtual auto Acquired() -> bool { return false; }
   virtual auto Acquire() -> bool { return false; }
   virtual auto Release() -> bool { return false; }
-  virtual auto Poll() -> vector<shared_ptr<sen::HID::Device>> { return {}; }
-  virtual auto Rumble(uint64_t id, bool enable) -> bool { return false; }
+  virtual auto Poll(vector<shared_ptr<sen::HID::Device>> &devices) -> void { devices.clear(); }
+  virtual auto Rumble(uint64_t id, uint16_t strong, uint16_t weak, uint16_t duration) -> bool { return false; }
+  virtual auto Rumble(Handle handle, uint16_t strong, uint16_t weak, uint16_t duration) -> bool { return false; }
+  virtual auto Statistics(uint64_t id) -> InputStatistics { return {}; }
+  virtual auto Statistics(Handle handle) -> InputStatistics { return {}; }
+  virtual auto Resync() -> void {}
+  virtual auto Record(const string &path) -> bool { return false; }
+  virtual auto Cache(const string &path) -> bool { return false; }
+  virtual auto Replay(const string &path, bool realtime) -> bool { return false; }
+  virtual auto Simulate(const vector<InputSimulation> &devices) -> bool { return false; }
 
  protected:
+  //rebuilds the device list with collect(list) only when generation moved, and
+  //only reassigns the caller's container when it differs from the list
+  template<typename F> auto Publish(vector<shared_ptr<sen::HID::Device>> &devices, uint generation, F &&collect) -> void {
+    if (generation_ != generation) {
+      generation_ = generation;
+      devices_.clear();
+      collect(devices_);
+    }
+    if (devices != devices_) devices = devices_;
+  }
+
   Input &super_;
   uintptr_t context_{0};
+  bool threaded_{false};
+  bool coalesced_{false};
+  uint motion_history_{0};
+  uint generation_{~0u};
+  vector<shared_ptr<sen::HID::Device>> devices_;
 
   friend struct Input;
 };
@@ -56,19 +146,98 @@ struct Input {
 
   auto SetContext(uintptr_t context) -> bool;
 
+  auto HasThreaded() -> bool { return instance_->HasThreaded(); }
+
+  auto Threaded() -> bool { return instance_->threaded_; }
+
+  auto SetThreaded(bool threaded) -> bool;
+
+  //coalesced: changes are delivered once per hardware report (SYN_REPORT), with
+  //only the final value of each input in it
+  auto HasCoalesced() -> bool { return instance_->HasCoalesced(); }
+
+  auto Coalesced() -> bool { return instance_->coalesced_; }
+
+  auto SetCoalesced(bool coalesced) -> bool;
+
+  //motion history: up to samples mouse reports decoded by each Poll() are kept
+  //for Motion(), while the mouse axes only report their per-poll sum; 0 disables it
+  auto HasMotionHistory() -> bool { return instance_->HasMotionHistory(); }
+
+  auto MotionHistory() -> uint { return instance_->motion_history_; }
+
+  auto SetMotionHistory(uint samples) -> bool;
+
+  //the reports of the last Poll(), oldest first
+  auto Motion(vector<InputMotion> &samples) -> void { instance_->Motion(samples); }
+
   auto Acquired() -> bool;
   auto Acquire() -> bool;
   auto Release() -> bool;
   auto Poll() -> vector<shared_ptr<sen::HID::Device>>;
+  auto Poll(vector<shared_ptr<sen::HID::Device>> &devices) -> void;
   auto Rumble(uint64_t id, bool enable) -> bool;
+  auto Rumble(Handle handle, bool enable) -> bool;
+  //strong/weak motor magnitudes (0 stops); duration in milliseconds, 0 plays until stopped.
+  //commands are queued and applied asynchronously, and may be issued from any thread;
+  //of the commands for one joypad still queued, only the latest is applied
+  auto Rumble(uint64_t id, uint16_t strong, uint16_t weak, uint duration = 0) -> bool;
+  auto Rumble(Handle handle, uint16_t strong, uint16_t weak, uint duration = 0) -> bool;
+  auto Statistics(uint64_t id) -> InputStatistics;
+  auto Statistics(Handle handle) -> InputStatistics;
+  //reads the held keys and buttons back from the devices, e.g. when the application
+  //regains focus; only inputs that differ are reported
+  auto Resync() -> void { instance_->Resync(); }
+  auto Record(const string &path) -> bool;
+  auto Cache(const string &path) -> bool;
+  auto Replay(const string &path, bool realtime = false) -> bool;
+  auto Simulate(const vector<InputSimulation> &devices) -> bool;
 
   auto OnChange(const function<void(shared_ptr<sen::HID::Device>, uint, uint, int16_t, int16_t)> &) -> void;
-  auto DoChange(shared_ptr<sen::HID::Device> device, uint group, uint input, int16_t old_value, int16_t new_value) -> void;
+  auto OnChangeBatch(const function<void(const InputChange *, size_t)> &) -> void;
+  //listeners are called from Poll() for the changes their filter matches; neither
+  //call may be made from inside a listener
+  auto Subscribe(const InputFilter &filter, const function<void(const InputChange &)> &listener) -> uint;
+  auto Unsubscribe(uint id) -> bool;
+  auto DoChange(sen::HID::Device &device, uint group, uint input, int16_t old_value, int16_t new_value, uint64_t timestamp = 0) -> void;
+  auto DoChange(const shared_ptr<sen::HID::Device> &device, uint group, uint input, int16_t old_value, int16_t new_value, uint64_t timestamp = 0) -> void {
+    DoChange(*device, group, input, old_value, new_value, timestamp);
+  }
 
  protected:
   Input &self;
   unique_ptr<InputDriver> instance_;
   function<void(shared_ptr<sen::HID::Device>, uint, uint, int16_t, int16_t)> change;
+  function<void(const InputChange *, size_t)> change_batch_;
+  vector<InputChange> changes_;
+  //the devices of changes_, kept alive until they are delivered
+  vector<shared_ptr<HID::Device>> retained_;
+  uint64_t timestamp_{0};
+
+ private:
+  struct Subscriber {
+    uint id;
+    InputFilter filter;
+    function<void(const InputChange &)> listener;
+  };
+
+  //the subscribers matching one device, bucketed by group: the candidates for
+  //group g are targets[offsets[g]] up to targets[offsets[g + 1]]. routes are
+  //indexed by Handle::index, and the few whose index is taken by a device of
+  //another registry are searched in route_collisions_
+  struct Route {
+    Handle handle;
+    vector<uint32_t> offsets;
+    vector<uint32_t> targets;
+  };
+
+  auto Dispatch() -> void;
+  auto Find(HID::Device &device) -> Route &;
+
+  vector<Subscriber> subscribers_;
+  vector<Route> routes_;
+  vector<Route> route_collisions_;
+  uint subscriber_{0};
 };
 
 }
@@ -0,0 +1,187 @@
+#ifndef JOYPAD_CACHE_HPP_
+#define JOYPAD_CACHE_HPP_
+
+#include "log.hpp"
+
+namespace sen {
+
+//probed joypad layouts persisted across runs, written with the JoypadLog encoding:
+//  header:  "SENCACHE" Version count
+//  entry:   key bustype vendor product version
+//           name deviceName vendorID productID manufacturer product serial rumble
+//           axes{code absinfo} hats{code absinfo} buttons{code}
+//key is built from stable udev properties; the EVIOCGID identity is compared
+//against the live device before an entry is trusted
+struct JoypadCache {
+  static constexpr char Magic[8] = {'S', 'E', 'N', 'C', 'A', 'C', 'H', 'E'};
+  enum : uint { Version = 1 };
+
+  struct Absolute {
+    uint16_t code;
+    input_absinfo info;
+  };
+
+  struct Entry {
+    string key;
+    input_id id{};
+    string name;
+    string deviceName;
+    string vendorID;
+    string productID;
+    string manufacturer;
+    string product;
+    string serial;
+    bool rumble = false;
+    vector<Absolute> axes;
+    vector<Absolute> hats;
+    vector<uint16_t> buttons;
+  };
+
+  //vendor:model:path:serial, or empty when the device has no stable physical path
+  static auto Key(udev_device *device) -> string {
+    auto property = [&](const char *name) -> string {
+      const char *value = udev_device_get_property_value(device, name);
+      return value ? value : "";
+    };
+    auto path = property("ID_PATH");
+    if (path.empty()) return {};
+    return property("ID_VENDOR_ID") + ":" + property("ID_MODEL_ID") + ":" + path + ":" + property("ID_SERIAL");
+  }
+
+  auto Find(const string &key) const -> const Entry * {
+    for (auto &entry : entries) {
+      if (entry.key == key) return &entry;
+    }
+    return nullptr;
+  }
+
+  auto Store(Entry entry) -> void {
+    for (auto &item : entries) {
+      if (item.key == entry.key) {
+        item = std::move(entry);
+        dirty = true;
+        return;
+      }
+    }
+    entries.push_back(std::move(entry));
+    dirty = true;
+  }
+
+  //a missing or unreadable file leaves the cache empty, it is rebuilt as devices are probed
+  auto Load(const string &filename) -> bool {
+    path = filename;
+    entries.clear();
+    dirty = false;
+    if (path.empty()) return true;
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno == ENOENT;
+    vector<uint8_t> data;
+    uint8_t buffer[4096];
+    for (ssize_t length; (length = read(fd, buffer, sizeof(buffer))) > 0;) data.insert(data.end(), buffer, buffer + length);
+    close(fd);
+
+    if (data.size() < sizeof(Magic) || memcmp(data.data(), Magic, sizeof(Magic)) != 0) return false;
+    JoypadLog::Reader reader{data.data() + sizeof(Magic), data.size() - sizeof(Magic)};
+    if (reader.Varint() != Version) return false;
+    auto absolute = [&](vector<Absolute> &inputs) {
+      for (uint n = 0, count = reader.Varint(); n < count && reader.ok; ++n) {
+        Absolute input{};
+        input.code = reader.Varint();
+        input.info.minimum = reader.Zigzag();
+        input.info.maximum = reader.Zigzag();
+        input.info.fuzz = reader.Zigzag();
+        input.info.flat = reader.Zigzag();
+        input.info.resolution = reader.Zigzag();
+        inputs.push_back(input);
+      }
+    };
+    for (uint n = 0, count = reader.Varint(); n < count && reader.ok; ++n) {
+      Entry entry;
+      entry.key = reader.String();
+      entry.id.bustype = reader.Varint();
+      entry.id.vendor = reader.Varint();
+      entry.id.product = reader.Varint();
+      entry.id.version = reader.Varint();
+      entry.name = reader.String();
+      entry.deviceName = reader.String();
+      entry.vendorID = reader.String();
+      entry.productID = reader.String();
+      entry.manufacturer = reader.String();
+      entry.product = reader.String();
+      entry.serial = reader.String();
+      entry.rumble = reader.Byte();
+      absolute(entry.axes);
+      absolute(entry.hats);
+      for (uint n = 0, count = reader.Varint(); n < count && reader.ok; ++n) entry.buttons.push_back(reader.Varint());
+      if (reader.ok) entries.push_back(std::move(entry));
+    }
+    return reader.ok;
+  }
+
+  //rewrites the whole file through a temporary, so a crash never leaves it truncated
+  auto Save() -> bool {
+    if (path.empty() || !dirty) return true;
+    JoypadLog::Writer writer;
+    writer.buffer.assign(Magic, Magic + sizeof(Magic));
+    writer.Varint(Version);
+    writer.Varint(entries.size());
+    auto absolute = [&](const vector<Absolute> &inputs) {
+      writer.Varint(inputs.size());
+      for (auto &input : inputs) {
+        writer.Varint(input.code);
+        writer.Zigzag(input.info.minimum);
+        writer.Zigzag(input.info.maximum);
+        writer.Zigzag(input.info.fuzz);
+        writer.Zigzag(input.info.flat);
+        writer.Zigzag(input.info.resolution);
+      }
+    };
+    for (auto &entry : entries) {
+      writer.String(entry.key);
+      writer.Varint(entry.id.bustype);
+      writer.Varint(entry.id.vendor);
+      writer.Varint(entry.id.product);
+      writer.Varint(entry.id.version);
+      writer.String(entry.name);
+      writer.String(entry.deviceName);
+      writer.String(entry.vendorID);
+      writer.String(entry.productID);
+      writer.String(entry.manufacturer);
+      writer.String(entry.product);
+      writer.String(entry.serial);
+      writer.Byte(entry.rumble);
+      absolute(entry.axes);
+      absolute(entry.hats);
+      writer.Varint(entry.buttons.size());
+      for (auto code : entry.buttons) writer.Varint(code);
+    }
+
+    auto temporary = path + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    auto data = writer.buffer.data();
+    auto size = writer.buffer.size();
+    while (size) {
+      auto written = write(fd, data, size);
+      if (written <= 0) break;
+      data += written;
+      size -= written;
+    }
+    close(fd);
+    if (size || rename(temporary.c_str(), path.c_str()) < 0) {
+      unlink(temporary.c_str());
+      return false;
+    }
+    dirty = false;
+    return true;
+  }
+
+  string path;
+  vector<Entry> entries;
+  bool dirty = false;
+};
+
+}
+
+#endif //JOYPAD_CACHE_HPP_
@@ -0,0 +1,84 @@
+#ifndef JOYPAD_LOG_HPP_
+#define JOYPAD_LOG_HPP_
+
+namespace sen {
+
+//compact evdev capture format written by InputJoypadUdev::Record() and read by InputReplay:
+//  header:  "SENINPUT" Version
+//  Device:  slot node name deviceName vendorID productID rumble
+//           axes{code absinfo} hats{code absinfo} buttons{code}
+//  Remove:  slot
+//  Events:  slot count {delta type code value}
+//integers are LEB128 varints, signed values are zigzag encoded, strings are
+//length prefixed; delta is the event time minus the previous event time (ns)
+struct JoypadLog {
+  static constexpr char Magic[8] = {'S', 'E', 'N', 'I', 'N', 'P', 'U', 'T'};
+  enum : uint { Version = 1 };
+  enum Tag : uint8_t { Device = 1, Remove = 2, Events = 3 };
+
+  struct Writer {
+    auto Byte(uint8_t value) -> void { buffer.push_back(value); }
+
+    auto Varint(uint64_t value) -> void {
+      while (value >= 0x80) {
+        buffer.push_back(uint8_t(value | 0x80));
+        value >>= 7;
+      }
+      buffer.push_back(uint8_t(value));
+    }
+
+    auto Zigzag(int64_t value) -> void { Varint(uint64_t(value) << 1 ^ uint64_t(value >> 63)); }
+
+    auto String(const string &value) -> void {
+      Varint(value.size());
+      buffer.insert(buffer.end(), value.begin(), value.end());
+    }
+
+    vector<uint8_t> buffer;
+  };
+
+  //reads from a borrowed buffer; ok turns false once the input is exhausted or malformed
+  struct Reader {
+    Reader() = default;
+    Reader(const uint8_t *data, size_t size) : data(data), end(data + size) {}
+
+    auto Byte() -> uint8_t {
+      if (data >= end) return ok = false, 0;
+      return *data++;
+    }
+
+    auto Varint() -> uint64_t {
+      uint64_t value = 0;
+      for (uint shift = 0; shift < 64; shift += 7) {
+        if (data >= end) return ok = false, 0;
+        uint8_t byte = *data++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return value;
+      }
+      return ok = false, 0;
+    }
+
+    auto Zigzag() -> int64_t {
+      auto value = Varint();
+      return int64_t(value >> 1) ^ -int64_t(value & 1);
+    }
+
+    auto String() -> string {
+      auto size = Varint();
+      if (size > uint64_t(end - data)) return ok = false, string{};
+      string value((const char *) data, size);
+      data += size;
+      return value;
+    }
+
+    auto Empty() const -> bool { return data >= end; }
+
+    const uint8_t *data = nullptr;
+    const uint8_t *end = nullptr;
+    bool ok = true;
+  };
+};
+
+}
+
+#endif //JOYPAD_LOG_HPP_
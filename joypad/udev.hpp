@@ -2,15 +2,28 @@
 #define JOYPAD_UDEV_HPP_
 
 #include <cstring>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include "../hid.h"
+#include "log.hpp"
+#include "cache.hpp"
 namespace sen {
 struct InputJoypadUdev {
   Input &input;
 
   explicit InputJoypadUdev(Input &input) : input(input) {}
+  //joins the input, probing and haptics threads before the state they use is destroyed
+  ~InputJoypadUdev() { Terminate(); }
 
+  static constexpr clockid_t clock = CLOCK_MONOTONIC;  //of Input timestamps, selected with EVIOCSCLOCKID for every opened joypad
   udev *context = nullptr;
   udev_monitor *monitor = nullptr;
+  int epoll = -1;
+  //receives the monitor's events for input devices that are not joypads, on the
+  //thread that reads the monitor: the input thread when threaded
+  function<void(udev_device *)> hotplug;
+  int wake = -1;
   udev_enumerate *enumerator = nullptr;
   udev_list_entry *devices = nullptr;
   udev_list_entry *item = nullptr;
@@ -24,15 +37,71 @@ struct InputJoypadUdev {
     JoypadInput() = default;
     explicit JoypadInput(int code) : code(code) {}
     JoypadInput(int code, uint id) : code(code), id(id) {}
-    bool operator<(const JoypadInput &source) const { return code < source.code; }
-    bool operator==(const JoypadInput &source) const { return code == source.code; }
+  };
+
+  //decode table entry, indexed by evdev code; group is Unmapped for unused codes.
+  //absolute values are normalized as ((value - minimum) * scale >> 32) - 32767, where
+  //scale = ceil(65535 * 2^32 / range) is split into 32-bit halves for the SIMD path
+  struct JoypadCode {
+    enum : uint8_t { Unmapped = 0xff };
+    uint8_t group{Unmapped};
+    uint16_t id{0};
+    uint16_t index{0};  //position among all of the joypad's inputs, see Joypad::staged
+    int32_t minimum{0};
+    uint32_t range{1};
+    uint32_t scaleHigh{65535};
+    uint32_t scaleLow{0};
+
+    auto SetRange(int32_t low, int32_t high) -> void {
+      minimum = low;
+      range = std::max<int64_t>(int64_t(high) - low, 1);
+      uint64_t whole = 65535 / range;
+      uint64_t fraction = ((uint64_t(65535 % range) << 32) + range - 1) / range;
+      scaleHigh = whole + (fraction >> 32);
+      scaleLow = uint32_t(fraction);
+    }
+
+    //value - minimum, clamped to [0, range]
+    auto Offset(int32_t value) const -> uint32_t {
+      return std::clamp<int64_t>(int64_t(value) - minimum, 0, range);
+    }
+
+    //the scalar form of Normalize() for one value
+    auto Normalize(int32_t value) const -> int16_t {
+      uint64_t offset = Offset(value);
+      int64_t normalized = offset * scaleHigh + (offset * scaleLow >> 32);
+      return int16_t(sclamp<16>(normalized - 32767));
+    }
+  };
+
+  //kernel event time -> dispatch, and read() -> dispatch
+  struct JoypadLatency {
+    Histogram kernel;
+    Histogram read;
+  };
+
+  //force feedback state, only touched by the haptics thread. fd is a duplicate of
+  //the joypad's descriptor, so a command in flight outlives the joypad's removal
+  struct JoypadHaptics {
+    ~JoypadHaptics() { if (fd >= 0) close(fd); }
+
+    static auto Upload(int fd, ff_effect &effect) -> bool { return ioctl(fd, EVIOCSFF, &effect) >= 0; }
+
+    int fd = -1;
+    int effectID = -1;  //uploaded rumble effect, reused for every command
+    ff_effect effect{};
+    bool playing = false;
+    uint64_t until = 0;  //when a timed effect stops by itself; 0 for an untimed one
+    bool (*upload)(int fd, ff_effect &effect) = Upload;  //replaceable for devices without evdev nodes
   };
 
   struct Joypad {
     shared_ptr<HID::Joypad> hid{new HID::Joypad};
+    shared_ptr<JoypadLatency> latency{new JoypadLatency};
 
     int fd = -1;
     dev_t device = 0;
+    input_id id{};
     string deviceName;
     string deviceNode;
 
@@ -49,110 +118,514 @@ struct InputJoypadUdev {
     string vendorID;
     string productID;
 
-    set<JoypadInput> axes;
-    set<JoypadInput> hats;
-    set<JoypadInput> buttons;
+    vector<JoypadInput> axes;
+    vector<JoypadInput> hats;
+    vector<JoypadInput> buttons;
+    JoypadCode absolutes[ABS_CNT];
+    JoypadCode keys[KEY_CNT - BTN_MISC];
     bool rumble = false;
-    int effectID = -1;
+    bool eventTime = true;  //false if EVIOCSCLOCKID failed: events carry another clock, so the read time is used
+    shared_ptr<JoypadHaptics> haptics;  //set by AppendJoypad() for joypads that can rumble
+    uint slot = 0;  //identifies the joypad in a recording
+    Handle handle;  //assigned by AppendJoypad()
+
+    //coalesced mode: values decoded since the last SYN_REPORT, one per input.
+    //staged[index] is the position in pending plus one, or zero
+    struct Staged {
+      uint8_t group;
+      uint16_t id;
+      uint16_t index;
+      int16_t value;
+      uint64_t timestamp;
+    };
+    vector<uint16_t> staged;
+    vector<Staged> pending;
+
+    bool dropped = false;  //SYN_DROPPED seen, waiting for the SYN_REPORT that ends it
+    uint64_t drops = 0;
+  };
+  //registry: joypads never move while they are registered; the maps index them
+  //by dev_t and device node, and byID by HID ID; callers may change IDs with
+  //SetID(), so byID is rebuilt by the first lookup after any such change
+  SlotMap<Joypad, 16, Handle::ReservedIndices> joypads;
+  std::unordered_map<dev_t, Handle> byDevice;
+  std::unordered_map<string, Handle> byNode;
+  std::unordered_map<uint64_t, Handle> byID;
+  uint64_t idChanges = ~0ull;  //HID::Device::IDChanges() when byID was built
+  std::atomic<uint> generation{0};  //bumped whenever a joypad is added or removed
+
+  //epoll tags of the non-joypad descriptors; joypads are tagged with their packed handle
+  enum : uint64_t { MonitorTag = ~0ull, WakeTag = ~0ull - 1 };
+
+  //threaded mode: a background thread decodes into changes, Poll() drains them.
+  //lock guards joypads against the thread; retired keeps removed devices alive
+  //until every change that was queued before their removal has been drained
+  struct Change {
+    HID::Joypad *hid;
+    JoypadLatency *latency;
+    uint group;
+    uint input;
+    int16_t value;
+    uint64_t timestamp;  //kernel event time
+    uint64_t received;   //time of the read() that returned the event
+  };
+  struct Retired {
+    shared_ptr<HID::Joypad> hid;
+    shared_ptr<JoypadLatency> latency;
+    uint64_t position;
   };
-  vector<Joypad> joypads;
+  Ring<Change, 4096> changes;
+  std::thread thread;
+  std::atomic<bool> running{false};
+  std::atomic<bool> stalled{false};  //the ring filled up; the thread waits on drained
+  int drained = -1;                  //signaled by Drain() once a stalled ring has room
+  bool threaded = false;
+  bool coalesced = false;  //stage changes until SYN_REPORT, see Stage()
+  std::mutex lock;
+  vector<Retired> retired;
+  std::atomic<bool> retiring{false};  //retired is not empty; lets Drain() skip the lock
+
+  //device probing runs on short-lived worker threads, each with its own udev
+  //context; probed joypads are appended by Publish() on the polling side.
+  //a probe whose device is removed before it is published is discarded
+  struct Probe {
+    string syspath;
+    string deviceNode;
+    uint64_t ticket;
+    bool started;
+  };
+  enum : uint { Probers = 8 };
+  std::mutex probeLock;
+  vector<Probe> probes;  //queued and in-flight
+  vector<Joypad> probed;
+  vector<std::thread> probers;
+  uint probersRunning = 0;
+  uint64_t tickets = 0;
+  JoypadCache cache;  //guarded by probeLock
+
+  //haptics: Rumble() queues commands, a thread started on first use applies them.
+  //commands for the same joypad that queue up while a slow device is busy are
+  //coalesced, only the latest one is applied, whether it names the joypad by ID
+  //or by handle. hapticLock serializes the producers of the single-producer ring
+  struct Haptic {
+    uint64_t id;    //used when handle is empty
+    Handle handle;
+    uint16_t strong;
+    uint16_t weak;
+    uint16_t duration;
+  };
+  Ring<Haptic, 256> haptics;
+  std::mutex hapticLock;
+  std::thread hapticThread;
+  std::atomic<bool> hapticRunning{false};
+  int hapticWake = -1;
+
+  //the kernel state read back by Resync(), replaceable for devices without evdev nodes
+  bool (*queryKeys)(int fd, uint8_t *keys, size_t size) = QueryKeys;
+  bool (*queryAbsolute)(int fd, uint code, input_absinfo &info) = QueryAbsolute;
 
-  auto Assign(const shared_ptr<HID::Joypad>& hid, uint groupID, uint inputID, int16_t value) -> void {
-    auto &group = hid->GetGroup(groupID);
+  //capture of the raw evdev stream, see JoypadLog
+  int recording = -1;
+  JoypadLog::Writer log;
+  uint64_t logTime = 0;
+  uint slots = 0;
 
-    if (group.GetInput(inputID).GetValue() == value)
+  //Read() reserves room for everything a read can emit; should the ring fill up
+  //anyway, the joypad is resynced by its next report rather than left stale
+  auto Emit(Joypad &jp, uint groupID, uint inputID, int16_t value, uint64_t timestamp, uint64_t received) -> void {
+    Change change{jp.hid.get(), jp.latency.get(), groupID, inputID, value, timestamp, received};
+    if (threaded) {
+      if (changes.Push(change)) return;
+      if (!jp.dropped) jp.drops++;
+      jp.dropped = true;
+      stalled = true;
+    } else {
+      Assign(change, received);  //dispatched right after the read
+    }
+  }
+
+  //in coalesced mode only the last value of each input within a report is kept,
+  //and the whole report is emitted at once when its SYN_REPORT arrives
+  auto Stage(Joypad &jp, const JoypadCode &entry, int16_t value, uint64_t timestamp, uint64_t received) -> void {
+    if (!coalesced) return Emit(jp, entry.group, entry.id, value, timestamp, received);
+    auto &slot = jp.staged[entry.index];
+    if (!slot) {
+      jp.pending.push_back({entry.group, entry.id, entry.index, value, timestamp});
+      slot = jp.pending.size();
+    } else {
+      jp.pending[slot - 1].value = value;
+      jp.pending[slot - 1].timestamp = timestamp;
+    }
+  }
+
+  auto Commit(Joypad &jp, uint64_t received) -> void {
+    for (auto &item : jp.pending) {
+      jp.staged[item.index] = 0;
+      Emit(jp, item.group, item.id, item.value, item.timestamp, received);
+    }
+    jp.pending.clear();
+  }
+
+  //switching coalescing off commits whatever is still staged
+  auto SetCoalesced(bool enable) -> bool {
+    std::lock_guard<std::mutex> guard(lock);
+    if (coalesced == enable) return true;
+    if (!enable) {
+      for (auto &jp : joypads) Commit(jp, 0);
+    }
+    coalesced = enable;
+    return true;
+  }
+
+  auto Assign(const Change &change, uint64_t dispatched) -> void {
+    auto item = change.hid->GetGroup(change.group).GetInput(change.input);
+
+    if (item.GetValue() == change.value)
       return;
-    input.DoChange(hid, groupID, inputID, group.GetInput(inputID).GetValue(), value);
-    group.GetInput(inputID).SetValue(value);
+    if (change.latency && change.received) {
+      change.latency->kernel.Record(dispatched > change.timestamp ? dispatched - change.timestamp : 0);
+      change.latency->read.Record(dispatched - change.received);
+    }
+    input.DoChange(*change.hid, change.group, change.input, item.GetValue(), change.value, change.timestamp);
+    item.SetValue(change.value);
   }
 
-  auto Poll(vector<shared_ptr<HID::Device>> &devs) -> void {
-    while (HotplugDevicesAvailable()) HotplugDevice();
+  auto Now() const -> uint64_t {
+    timespec now{};
+    clock_gettime(clock, &now);
+    return uint64_t(now.tv_sec) * 1'000'000'000 + uint64_t(now.tv_nsec);
+  }
 
-    for (auto &jp : joypads) {
-      input_event events[32];
-      int64_t length = 0;
-      while ((length = read(jp.fd, events, sizeof(events))) > 0) {
-        length /= sizeof(input_event);
-        for (uint i = 0; i < length; ++i) {
-          int code = events[i].code;
-          int type = events[i].type;
-          int value = events[i].value;
-
-          if (type == EV_ABS) {
-            auto iter_axes = jp.axes.find(JoypadInput{code});
-
-            if (iter_axes != jp.axes.end()) {
-              int range = iter_axes->info.maximum - iter_axes->info.minimum;
-              value = (value - iter_axes->info.minimum) * 65535 / range - 32767;
-              Assign(jp.hid, HID::Joypad::GroupID::Axis, iter_axes->id, int16_t(sclamp<16>(value)));
-            } else {
-              auto iter_hat = jp.hats.find(JoypadInput{code});
-              if (iter_hat != jp.hats.end()) {
-                int range = iter_hat->info.maximum - iter_hat->info.minimum;
-                value = (value - iter_hat->info.minimum) * 65535 / range - 32767;
-                Assign(jp.hid, HID::Joypad::GroupID::Hat, iter_hat->id, int16_t(sclamp<16>(value)));
-              }
-            }
-          } else if (type == EV_KEY) {
-            if (code >= BTN_MISC) {
-              auto iter_button = jp.axes.find(JoypadInput{code});
-              if (iter_button != jp.buttons.end()) {
-                Assign(jp.hid, HID::Joypad::GroupID::Button, iter_button->id, (bool) value);
-              }
-            }
-          }
+  auto Poll() -> void {
+    if (threaded) return Drain();
+    epoll_event ready[64];
+    Dispatch(ready, epoll_wait(epoll, ready, 64, 0));
+  }
+
+  auto Devices(vector<shared_ptr<HID::Device>> &devs) -> void {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto &jp : joypads) devs.push_back(jp.hid);
+  }
+
+  //applies every change queued by the input thread; no syscalls are made here
+  auto Drain() -> void {
+    Change change{};
+    uint64_t dispatched = 0;
+    while (changes.Pop(change)) {
+      if (!dispatched) dispatched = Now();
+      Assign(change, dispatched);
+    }
+    if (stalled.exchange(false)) {
+      uint64_t signal = 1;
+      (void) !write(drained, &signal, sizeof(signal));
+    }
+    if (!retiring) return;
+    std::lock_guard<std::mutex> guard(lock);
+    auto consumed = changes.Consumed();
+    retired.erase(std::remove_if(retired.begin(), retired.end(), [&](auto &item) {
+      return item.position <= consumed;
+    }), retired.end());
+    retiring = !retired.empty();
+  }
+
+  //only devices with pending events cost a syscall; hotplug is handled after reads
+  //so that a removed device's fd is never read after it has been closed. the input
+  //thread only holds lock for one device's read at a time, and to finish up
+  auto Dispatch(const epoll_event *ready, int count) -> void {
+    bool hotplug = false;
+    bool publish = false;
+    for (int n = 0; n < count; ++n) {
+      if (ready[n].data.u64 == MonitorTag) {
+        hotplug = true;
+        continue;
+      }
+      if (ready[n].data.u64 == WakeTag) {
+        uint64_t signal;
+        (void) !read(wake, &signal, sizeof(signal));
+        publish = true;
+        continue;
+      }
+      std::unique_lock<std::mutex> guard(lock, std::defer_lock);
+      if (threaded) guard.lock();
+      if (auto jp = joypads.Find(Handle::Unpack(ready[n].data.u64))) Read(*jp);
+    }
+    //the haptics thread looks joypads up under lock
+    std::unique_lock<std::mutex> guard(lock, std::defer_lock);
+    if (threaded || publish || hotplug) guard.lock();
+    if (publish) Publish();
+    if (hotplug) HotplugDevices();
+    //the recording is written out once per dispatch, so a crash loses at most one poll
+    if (recording >= 0 && !log.buffer.empty()) Flush(true);
+  }
+
+  auto Read(Joypad &jp) -> void {
+    input_event events[32];
+    int64_t length = 0;
+    uint inputs = jp.buttons.size() + jp.axes.size() + jp.hats.size();
+    do {
+      //leave events in the kernel buffer rather than overflow the change ring: a read
+      //emits one change per event, the values staged by earlier reads when its
+      //SYN_REPORT commits them, and every input when it resyncs after a SYN_DROPPED
+      if (threaded && changes.Free() < 32 + jp.pending.size() + inputs) {
+        stalled = true;
+        return;
+      }
+      length = read(jp.fd, events, sizeof(events));
+      if (length <= 0) return;
+      LogEvents(jp, events, length / sizeof(input_event));
+      Decode(jp, events, length / sizeof(input_event), Now());
+    } while (length == sizeof(events));  //a short read means the kernel buffer is drained
+  }
+
+  //absolute values are normalized inline, one multiply each. dropped is kept in
+  //a local: the compiler cannot keep jp.dropped in a register across Assign()
+  auto Decode(Joypad &jp, const input_event *events, uint count, uint64_t received = 0) -> void {
+    bool eventTime = jp.eventTime || !received;
+    auto time = [&](const input_event &event) { return eventTime ? Timestamp(event) : received; };
+    bool dropped = jp.dropped;
+    for (uint i = 0; i < count; ++i) {
+      uint code = events[i].code;
+      if (events[i].type == EV_ABS) {
+        if (code >= ABS_CNT || dropped) continue;
+        auto &entry = jp.absolutes[code];
+        if (entry.group == JoypadCode::Unmapped) continue;
+        Stage(jp, entry, entry.Normalize(events[i].value), time(events[i]), received);
+      } else if (events[i].type == EV_KEY) {
+        if (code < BTN_MISC || code >= KEY_CNT || dropped) continue;
+        auto &entry = jp.keys[code - BTN_MISC];
+        if (entry.group == JoypadCode::Unmapped) continue;
+        Stage(jp, entry, (bool) events[i].value, time(events[i]), received);
+      } else if (events[i].type == EV_SYN && code == SYN_DROPPED) {
+        Drop(jp);
+        dropped = true;
+      } else if (events[i].type == EV_SYN && code == SYN_REPORT) {
+        if (jp.dropped) {
+          Resync(jp, time(events[i]), received);
+        } else if (!jp.pending.empty()) {
+          Commit(jp, received);
         }
+        dropped = jp.dropped;
       }
+    }
+  }
+
+  //the kernel buffer overflowed: everything up to the next SYN_REPORT is stale,
+  //including values staged from the incomplete report before the drop
+  auto Drop(Joypad &jp) -> void {
+    if (!jp.dropped) jp.drops++;
+    jp.dropped = true;
+    for (auto &item : jp.pending) jp.staged[item.index] = 0;
+    jp.pending.clear();
+  }
+
+  //reads the current state of every input from the kernel; Assign() turns only
+  //the inputs that really differ from the HID state into changes
+  auto Resync(Joypad &jp, uint64_t timestamp, uint64_t received) -> void {
+    jp.dropped = false;
+    if (jp.fd < 0) return;  //replayed or simulated joypads have no kernel state
 
-      devs.push_back(jp.hid);
+    uint8_t keys[(KEY_MAX + 7) / 8] = {0};
+    if (queryKeys(jp.fd, keys, sizeof(keys))) {
+      for (auto &button : jp.buttons) {
+        bool value = keys[button.code >> 3] & 1 << (button.code & 7);
+        Emit(jp, HID::Joypad::GroupID::Button, button.id, value, timestamp, received);
+      }
     }
+
+    auto absolute = [&](const JoypadInput &source) {
+      input_absinfo info{};
+      if (!queryAbsolute(jp.fd, source.code, info)) return;
+      auto &entry = jp.absolutes[source.code];
+      Emit(jp, entry.group, entry.id, entry.Normalize(info.value), timestamp, received);
+    };
+    for (auto &axis : jp.axes) absolute(axis);
+    for (auto &hat : jp.hats) absolute(hat);
   }
 
-  auto Rumble(uint64_t id, bool enable) -> bool {
+  //reads every joypad back from the kernel, see Input::Resync(); a joypad waiting
+  //for the end of a SYN_DROPPED is resynced by that report instead
+  auto Resync() -> void {
+    std::unique_lock<std::mutex> guard(lock, std::defer_lock);
+    if (threaded) guard.lock();  //the input thread is the ring's producer
+    auto now = Now();
     for (auto &jp : joypads) {
-      if (jp.hid->GetID() != id) continue;
-      if (!jp.hid->GetRumble()) continue;
-
-      if (!enable) {
-        if (jp.effectID == -1) return true;  //already stopped?
-
-        ioctl(jp.fd, EVIOCRMFF, jp.effectID);
-        jp.effectID = -1;
-      } else {
-        if (jp.effectID != -1) return true;  //already started?
-
-        ff_effect effect{};
-        memset(&effect, 0, sizeof(ff_effect));
-        effect.type = FF_RUMBLE;
-        effect.id = -1;
-        effect.u.rumble.strong_magnitude = 65535;
-        effect.u.rumble.weak_magnitude = 65535;
-        ioctl(jp.fd, EVIOCSFF, &effect);
-        jp.effectID = effect.id;
-
-        input_event play{};
-        memset(&effect, 0, sizeof(ff_effect));
-        play.type = EV_FF;
-        play.code = jp.effectID;
-        play.value = enable;
-        (void) write(jp.fd, &play, sizeof(input_event));
-      }
+      if (!jp.dropped) Resync(jp, now, 0);
+    }
+  }
 
-      return true;
+  static auto QueryKeys(int fd, uint8_t *keys, size_t size) -> bool {
+    return ioctl(fd, EVIOCGKEY(size), keys) >= 0;
+  }
+
+  static auto QueryAbsolute(int fd, uint code, input_absinfo &info) -> bool {
+    return ioctl(fd, EVIOCGABS(code), &info) >= 0;
+  }
+
+  //values[n] = sclamp<16>((offsets[n] * (highs[n]:lows[n]) >> 32) - 32767); uses
+  //AVX2 or SSE2 when the build targets them, with a scalar loop for the tail.
+  //for values that are already gathered: Decode() normalizes inline instead
+  static auto Normalize(const uint32_t *offsets, const uint32_t *highs, const uint32_t *lows, int16_t *values, uint count) -> void {
+    uint n = 0;
+#if defined(__AVX2__)
+    const __m256i mask = _mm256_set1_epi64x(0xffffffff00000000ll);
+    const __m256i bias = _mm256_set1_epi32(32767);
+    for (; n + 8 <= count; n += 8) {
+      __m256i x = _mm256_loadu_si256((const __m256i *) (offsets + n));
+      __m256i high = _mm256_loadu_si256((const __m256i *) (highs + n));
+      __m256i low = _mm256_loadu_si256((const __m256i *) (lows + n));
+      __m256i xOdd = _mm256_srli_epi64(x, 32);
+      //upper 32 bits of x * low, for even and odd lanes
+      __m256i fraction = _mm256_or_si256(
+        _mm256_srli_epi64(_mm256_mul_epu32(x, low), 32),
+        _mm256_and_si256(_mm256_mul_epu32(xOdd, _mm256_srli_epi64(low, 32)), mask));
+      //lower 32 bits of x * high (the product never exceeds 65535)
+      __m256i whole = _mm256_or_si256(
+        _mm256_andnot_si256(mask, _mm256_mul_epu32(x, high)),
+        _mm256_slli_epi64(_mm256_mul_epu32(xOdd, _mm256_srli_epi64(high, 32)), 32));
+      __m256i result = _mm256_sub_epi32(_mm256_add_epi32(whole, fraction), bias);
+      __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(result, result), 0x08);
+      _mm_storeu_si128((__m128i *) (values + n), _mm256_castsi256_si128(packed));
     }
+#elif defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi64x(0xffffffff00000000ll);
+    const __m128i bias = _mm_set1_epi32(32767);
+    for (; n + 4 <= count; n += 4) {
+      __m128i x = _mm_loadu_si128((const __m128i *) (offsets + n));
+      __m128i high = _mm_loadu_si128((const __m128i *) (highs + n));
+      __m128i low = _mm_loadu_si128((const __m128i *) (lows + n));
+      __m128i xOdd = _mm_srli_epi64(x, 32);
+      __m128i fraction = _mm_or_si128(
+        _mm_srli_epi64(_mm_mul_epu32(x, low), 32),
+        _mm_and_si128(_mm_mul_epu32(xOdd, _mm_srli_epi64(low, 32)), mask));
+      __m128i whole = _mm_or_si128(
+        _mm_andnot_si128(mask, _mm_mul_epu32(x, high)),
+        _mm_slli_epi64(_mm_mul_epu32(xOdd, _mm_srli_epi64(high, 32)), 32));
+      __m128i result = _mm_sub_epi32(_mm_add_epi32(whole, fraction), bias);
+      _mm_storel_epi64((__m128i *) (values + n), _mm_packs_epi32(result, result));
+    }
+#endif
+    for (; n < count; ++n) {
+      int64_t value = uint64_t(offsets[n]) * highs[n] + (uint64_t(offsets[n]) * lows[n] >> 32);
+      values[n] = int16_t(sclamp<16>(value - 32767));
+    }
+  }
 
-    return false;
+  static auto Timestamp(const input_event &event) -> uint64_t {
+    return uint64_t(event.input_event_sec) * 1'000'000'000 + uint64_t(event.input_event_usec) * 1'000;
+  }
+
+  auto Find(Handle handle) -> Joypad * { return joypads.Find(handle); }
+
+  auto FindDevice(dev_t device) -> Joypad * {
+    auto item = byDevice.find(device);
+    return item != byDevice.end() ? joypads.Find(item->second) : nullptr;
+  }
+
+  auto FindNode(const string &deviceNode) -> Joypad * {
+    auto item = byNode.find(deviceNode);
+    return item != byNode.end() ? joypads.Find(item->second) : nullptr;
+  }
+
+  //of joypads sharing an ID, only one is found
+  auto FindID(uint64_t id) -> Joypad * {
+    if (idChanges != HID::Device::IDChanges()) {
+      idChanges = HID::Device::IDChanges();
+      byID.clear();
+      for (auto &jp : joypads) byID.emplace(jp.hid->GetID(), jp.handle);
+    }
+    auto item = byID.find(id);
+    return item != byID.end() ? joypads.Find(item->second) : nullptr;
+  }
+
+  auto Statistics(uint64_t id) -> InputStatistics {
+    std::lock_guard<std::mutex> guard(lock);
+    auto jp = FindID(id);
+    return jp ? Statistics(*jp) : InputStatistics{};
+  }
+
+  auto Statistics(Handle handle) -> InputStatistics {
+    std::lock_guard<std::mutex> guard(lock);
+    auto jp = Find(handle);
+    return jp ? Statistics(*jp) : InputStatistics{};
+  }
+
+  //queues a command for the haptics thread and never waits for a read or poll; a
+  //full queue drops it. hapticLock lets any thread queue commands
+  auto Rumble(uint64_t id, uint16_t strong, uint16_t weak, uint16_t duration) -> bool {
+    return Queue({id, {}, strong, weak, duration});
+  }
+
+  auto Rumble(Handle handle, uint16_t strong, uint16_t weak, uint16_t duration) -> bool {
+    return Queue({0, handle, strong, weak, duration});
+  }
+
+  static auto Statistics(const Joypad &jp) -> InputStatistics {
+    auto latency = [](const Histogram &histogram) -> InputLatency {
+      return {histogram.Count(), histogram.Percentile(0.50), histogram.Percentile(0.99), histogram.Maximum()};
+    };
+    return {latency(jp.latency->kernel), latency(jp.latency->read), jp.drops};
+  }
+
+  //the effect is uploaded once and then updated in place through the same id;
+  //starting and stopping it is a single EV_FF write. timed effects are replayed
+  //on every call, so that an envelope can be streamed as a series of short ones.
+  //now is on the joypad clock, in nanoseconds
+  static auto Rumble(JoypadHaptics &haptics, uint16_t strong, uint16_t weak, uint16_t duration, uint64_t now) -> bool {
+    //a timed effect that ran out has stopped without an EV_FF write
+    bool active = haptics.playing && (!haptics.until || now < haptics.until);
+    if (!strong && !weak) {
+      haptics.playing = false;
+      if (haptics.effectID < 0 || !active) return true;
+      return Play(haptics, 0);
+    }
+
+    auto &effect = haptics.effect;
+    bool length = effect.replay.length != duration;
+    if (haptics.effectID < 0 || effect.type != FF_RUMBLE || length
+        || effect.u.rumble.strong_magnitude != strong || effect.u.rumble.weak_magnitude != weak) {
+      effect = {};
+      effect.type = FF_RUMBLE;
+      effect.id = haptics.effectID;  //-1 allocates a new effect
+      effect.replay.length = duration;
+      effect.u.rumble.strong_magnitude = strong;
+      effect.u.rumble.weak_magnitude = weak;
+      if (!haptics.upload(haptics.fd, effect)) {
+        effect.type = 0;  //upload again next time
+        return false;
+      }
+      haptics.effectID = effect.id;
+    }
+
+    haptics.until = duration ? now + duration * 1'000'000ull : 0;
+    if (active && !duration && !length) return true;  //an updated effect keeps playing
+    haptics.playing = true;
+    return Play(haptics, 1);
+  }
+
+  static auto Play(const JoypadHaptics &haptics, int32_t value) -> bool {
+    input_event play{};
+    play.type = EV_FF;
+    play.code = haptics.effectID;
+    play.value = value;
+    return write(haptics.fd, &play, sizeof(play)) == sizeof(play);
   }
 
   auto Initialize() -> bool {
     context = udev_new();
     if (context == nullptr) return false;
 
+    epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll < 0) return false;
+
+    wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake < 0) return false;
+    Watch(wake, WakeTag);
+
     monitor = udev_monitor_new_from_netlink(context, "udev");
     if (monitor) {
       udev_monitor_filter_add_match_subsystem_devtype(monitor, "input", nullptr);
       udev_monitor_enable_receiving(monitor);
+      Watch(udev_monitor_get_fd(monitor), MonitorTag);
     }
 
     enumerator = udev_enumerate_new(context);
@@ -161,10 +634,9 @@ struct InputJoypadUdev {
       udev_enumerate_scan_devices(enumerator);
       devices = udev_enumerate_get_list_entry(enumerator);
       for (udev_list_entry *iter = devices; iter != nullptr; iter = udev_list_entry_get_next(iter)) {
-        string name = udev_list_entry_get_name(iter);
-        udev_device *device = udev_device_new_from_syspath(context, name.c_str());
-        string device_node = udev_device_get_devnode(device);
-        if (!device_node.empty()) CreateJoypad(device, device_node);
+        udev_device *device = udev_device_new_from_syspath(context, udev_list_entry_get_name(iter));
+        if (!device) continue;
+        if (const char *deviceNode = udev_device_get_devnode(device)) Schedule(udev_device_get_syspath(device), deviceNode);
         udev_device_unref(device);
       }
     }
@@ -172,48 +644,425 @@ struct InputJoypadUdev {
     return true;
   }
 
+  //joypads must not be appended from outside while the thread is running
+  auto SetThreaded(bool enable) -> bool {
+    if (threaded == enable) return true;
+    if (!enable) {
+      running = false;
+      uint64_t signal = 1;
+      (void) !write(wake, &signal, sizeof(signal));
+      (void) !write(drained, &signal, sizeof(signal));
+      thread.join();
+      threaded = false;
+      stalled = false;
+      close(drained);
+      drained = -1;
+      Drain();
+      return true;
+    }
+    if (epoll < 0) return false;
+    if (wake < 0) {
+      wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (wake < 0) return false;
+      Watch(wake, WakeTag);
+    }
+    drained = eventfd(0, EFD_CLOEXEC);
+    if (drained < 0) return false;
+    threaded = running = true;
+    thread = std::thread([this] { Run(); });
+    return true;
+  }
+
   auto Terminate() -> void {
+    SetThreaded(false);
+    StopHaptics();
+    CancelProbes();
+    Record("");
+    retired.clear();
+    retiring = false;
     if (enumerator) {
       udev_enumerate_unref(enumerator);
       enumerator = nullptr;
     }
+    for (auto &jp : joypads) close(jp.fd);
+    joypads.clear();
+    byDevice.clear();
+    byNode.clear();
+    byID.clear();
+    generation++;
+    if (monitor) {
+      udev_monitor_unref(monitor);
+      monitor = nullptr;
+    }
+    if (context) {
+      udev_unref(context);
+      context = nullptr;
+    }
+    if (wake >= 0) {
+      close(wake);
+      wake = -1;
+    }
+    if (epoll >= 0) {
+      close(epoll);
+      epoll = -1;
+    }
+  }
+
+  //registers an already probed joypad; jp.fd must be non-blocking. the returned
+  //reference stays valid until the joypad is removed
+  auto AppendJoypad(Joypad &jp) -> Joypad & {
+    CreateJoypadHID(jp);
+    jp.slot = slots++;
+    LogDevice(jp);
+    auto handle = joypads.Insert(jp);
+    auto &entry = *joypads.Find(handle);
+    entry.handle = handle;
+    entry.hid->SetHandle(handle);
+    if (entry.rumble && entry.fd >= 0) {
+      entry.haptics = std::make_shared<JoypadHaptics>();
+      entry.haptics->fd = fcntl(entry.fd, F_DUPFD_CLOEXEC, 0);
+    }
+    Watch(entry.fd, handle.Pack());
+    if (entry.device) byDevice[entry.device] = handle;
+    if (!entry.deviceNode.empty()) byNode[entry.deviceNode] = handle;
+    byID.emplace(entry.hid->GetID(), handle);
+    generation++;
+    return entry;
+  }
+
+  auto RemoveJoypad(udev_device *, const string &device_node) -> void {
+    {
+      std::lock_guard<std::mutex> guard(probeLock);
+      probes.erase(std::remove_if(probes.begin(), probes.end(), [&](auto &probe) {
+        return probe.deviceNode == device_node;
+      }), probes.end());
+      for (uint n = 0; n < probed.size(); ++n) {
+        if (probed[n].deviceNode != device_node) continue;
+        close(probed[n].fd);
+        probed.erase(probed.begin() + n--);
+      }
+    }
+    if (auto jp = FindNode(device_node)) RemoveJoypad(*jp);
+  }
+
+  auto RemoveJoypad(Joypad &jp) -> void {
+    epoll_ctl(epoll, EPOLL_CTL_DEL, jp.fd, nullptr);
+    close(jp.fd);
+    if (threaded) {
+      retired.push_back({jp.hid, jp.latency, changes.Written()});
+      retiring = true;
+    }
+    LogRemove(jp);
+    if (jp.device) byDevice.erase(jp.device);
+    byNode.erase(jp.deviceNode);
+    auto id = byID.find(jp.hid->GetID());
+    if (id != byID.end() && id->second == jp.handle) {
+      byID.erase(id);
+      for (auto &other : joypads) {
+        if (&other != &jp && other.hid->GetID() == jp.hid->GetID()) {
+          byID.emplace(other.hid->GetID(), other.handle);
+          break;
+        }
+      }
+    }
+    joypads.Erase(jp.handle);
+    generation++;
+  }
+
+  //starts capturing every joypad and its raw events into path; an empty path stops
+  auto Record(const string &path) -> bool {
+    std::lock_guard<std::mutex> guard(lock);
+    if (recording >= 0) {
+      Flush(true);
+      close(recording);
+      recording = -1;
+    }
+    if (path.empty()) return true;
+
+    recording = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (recording < 0) return false;
+    log.buffer.assign(JoypadLog::Magic, JoypadLog::Magic + sizeof(JoypadLog::Magic));
+    log.Varint(JoypadLog::Version);
+    logTime = 0;
+    for (auto &jp : joypads) LogDevice(jp);
+    return true;
+  }
+
+  //uses path as the persistent capability cache; an empty path disables it
+  auto Cache(const string &path) -> bool {
+    std::lock_guard<std::mutex> guard(probeLock);
+    cache.Save();
+    return cache.Load(path);
+  }
+
+  static auto Capture(const Joypad &jp, const string &key) -> JoypadCache::Entry {
+    JoypadCache::Entry entry;
+    entry.key = key;
+    entry.id = jp.id;
+    entry.name = jp.name;
+    entry.deviceName = jp.deviceName;
+    entry.vendorID = jp.vendorID;
+    entry.productID = jp.productID;
+    entry.manufacturer = jp.manufacturer;
+    entry.product = jp.product;
+    entry.serial = jp.serial;
+    entry.rumble = jp.rumble;
+    for (auto &axis : jp.axes) entry.axes.push_back({uint16_t(axis.code), axis.info});
+    for (auto &hat : jp.hats) entry.hats.push_back({uint16_t(hat.code), hat.info});
+    for (auto &button : jp.buttons) entry.buttons.push_back(button.code);
+    return entry;
+  }
+
+  //fills jp from a cache entry if it describes the same hardware as the open device
+  static auto Restore(Joypad &jp, const JoypadCache::Entry &entry) -> bool {
+    if (jp.id.bustype != entry.id.bustype || jp.id.vendor != entry.id.vendor
+        || jp.id.product != entry.id.product || jp.id.version != entry.id.version) return false;
+    jp.name = entry.name;
+    jp.deviceName = entry.deviceName;
+    jp.vendorID = entry.vendorID;
+    jp.productID = entry.productID;
+    jp.manufacturer = entry.manufacturer;
+    jp.product = entry.product;
+    jp.serial = entry.serial;
+    jp.rumble = entry.rumble;
+    for (auto &axis : entry.axes) {
+      jp.axes.emplace_back(axis.code, jp.axes.size());
+      jp.axes.back().info = axis.info;
+    }
+    for (auto &hat : entry.hats) {
+      jp.hats.emplace_back(hat.code, jp.hats.size());
+      jp.hats.back().info = hat.info;
+    }
+    for (auto code : entry.buttons) jp.buttons.emplace_back(code, jp.buttons.size());
+    return true;
   }
 
  private:
-  auto HotplugDevicesAvailable() const -> bool {
-    pollfd fd = {0};
-    fd.fd = udev_monitor_get_fd(monitor);
-    fd.events = POLLIN;
-    return (::poll(&fd, 1, 0) == 1) && (fd.revents & POLLIN);
-  }
-
-  auto HotplugDevice() -> void {
-    udev_device *device = udev_monitor_receive_device(monitor);
-    if (device == nullptr) return;
-
-    string value = udev_device_get_property_value(device, "ID_INPUT_JOYSTICK");
-    string action = udev_device_get_action(device);
-    string deviceNode = udev_device_get_devnode(device);
-    if (value == "1") {
-      if (action == "add") {
-        CreateJoypad(device, deviceNode);
+  auto Queue(const Haptic &command) -> bool {
+    std::lock_guard<std::mutex> guard(hapticLock);
+    if (!hapticRunning) {
+      if (hapticWake < 0) hapticWake = eventfd(0, EFD_CLOEXEC);
+      if (hapticWake < 0) return false;
+      hapticRunning = true;
+      hapticThread = std::thread([this] { Haptics(); });
+    }
+    if (!haptics.Push(command)) return false;
+    uint64_t signal = 1;
+    (void) !write(hapticWake, &signal, sizeof(signal));
+    return true;
+  }
+
+  auto Haptics() -> void {
+    vector<Haptic> batch;
+    vector<shared_ptr<JoypadHaptics>> targets;
+    while (hapticRunning) {
+      uint64_t signal;
+      if (read(hapticWake, &signal, sizeof(signal)) < 0 && errno != EINTR) break;
+
+      //commands are coalesced by the joypad they resolve to
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        Haptic command;
+        while (haptics.Pop(command)) {
+          auto jp = command.handle ? Find(command.handle) : FindID(command.id);
+          if (!jp || !jp->haptics) continue;
+          auto same = std::find(targets.begin(), targets.end(), jp->haptics);
+          if (same != targets.end()) {
+            batch[same - targets.begin()] = command;
+          } else {
+            batch.push_back(command);
+            targets.push_back(jp->haptics);
+          }
+        }
+      }
+      //the slow part runs without the lock, so polling never waits for a device
+      auto now = Now();
+      for (uint n = 0; n < batch.size(); ++n) {
+        Rumble(*targets[n], batch[n].strong, batch[n].weak, batch[n].duration, now);
+      }
+      batch.clear();
+      targets.clear();
+    }
+  }
+
+  auto StopHaptics() -> void {
+    std::lock_guard<std::mutex> guard(hapticLock);
+    if (hapticRunning) {
+      hapticRunning = false;
+      uint64_t signal = 1;
+      (void) !write(hapticWake, &signal, sizeof(signal));
+      hapticThread.join();
+    }
+    if (hapticWake >= 0) {
+      close(hapticWake);
+      hapticWake = -1;
+    }
+    Haptic command;
+    while (haptics.Pop(command));
+  }
+
+  //while the consumer is behind, the devices stay readable and epoll would return at
+  //once; the thread sleeps on drained until the next Drain() instead
+  auto Run() -> void {
+    epoll_event ready[64];
+    while (running) {
+      if (stalled) {
+        uint64_t signal;
+        if (read(drained, &signal, sizeof(signal)) < 0 && errno != EINTR) break;
+        continue;
       }
-      if (action == "remove") {
-        RemoveJoypad(device, deviceNode);
+      int count = epoll_wait(epoll, ready, 64, -1);
+      if (count < 0 && errno != EINTR) break;
+      Dispatch(ready, count);
+    }
+  }
+
+  auto Watch(int fd, uint64_t tag) -> void {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = tag;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+  }
+
+  //the monitor socket is non-blocking, so drain it until no device is pending
+  auto HotplugDevices() -> void {
+    while (udev_device *device = udev_monitor_receive_device(monitor)) {
+      HotplugDevice(device);
+      udev_device_unref(device);
+    }
+  }
+
+  auto HotplugDevice(udev_device *device) -> void {
+    const char *value = udev_device_get_property_value(device, "ID_INPUT_JOYSTICK");
+    const char *action = udev_device_get_action(device);
+    const char *deviceNode = udev_device_get_devnode(device);
+    if (!action || !deviceNode) return;
+    if (!value || string(value) != "1") {
+      if (hotplug) hotplug(device);
+      return;
+    }
+    if (string(action) == "add") {
+      Schedule(udev_device_get_syspath(device), deviceNode);
+    }
+    if (string(action) == "remove") {
+      RemoveJoypad(device, deviceNode);
+    }
+  }
+
+  //queues a device for probing, starting another worker if all are busy
+  auto Schedule(const char *syspath, const char *deviceNode) -> void {
+    if (!syspath) return;
+    std::lock_guard<std::mutex> guard(probeLock);
+    probes.push_back({syspath, deviceNode, tickets++, false});
+    uint queued = std::count_if(probes.begin(), probes.end(), [](auto &probe) { return !probe.started; });
+    if (probersRunning < Probers && probersRunning < queued) {
+      probersRunning++;
+      probers.emplace_back([this] { Prober(); });
+    }
+  }
+
+  auto Prober() -> void {
+    udev *local = udev_new();
+    while (true) {
+      Probe probe;
+      {
+        std::lock_guard<std::mutex> guard(probeLock);
+        auto next = std::find_if(probes.begin(), probes.end(), [](auto &probe) { return !probe.started; });
+        if (next == probes.end()) {
+          probersRunning--;
+          break;
+        }
+        next->started = true;
+        probe = *next;
       }
+
+      Joypad jp;
+      string key;
+      bool restored = false;
+      udev_device *device = local ? udev_device_new_from_syspath(local, probe.syspath.c_str()) : nullptr;
+      if (device) {
+        key = JoypadCache::Key(device);
+        JoypadCache::Entry entry;
+        bool cached = false;
+        if (!key.empty()) {
+          std::lock_guard<std::mutex> guard(probeLock);
+          if (auto item = cache.Find(key)) entry = *item, cached = true;
+        }
+        restored = CreateJoypad(device, probe.deviceNode, jp, cached ? &entry : nullptr);
+        udev_device_unref(device);
+      }
+
+      {
+        std::lock_guard<std::mutex> guard(probeLock);
+        if (jp.fd >= 0 && !key.empty() && !restored) cache.Store(Capture(jp, key));
+        auto current = std::find_if(probes.begin(), probes.end(), [&](auto &item) { return item.ticket == probe.ticket; });
+        if (current == probes.end()) {
+          if (jp.fd >= 0) close(jp.fd);  //removed while it was being probed
+          continue;
+        }
+        probes.erase(current);
+        if (jp.fd < 0) continue;
+        probed.push_back(std::move(jp));
+      }
+      uint64_t signal = 1;
+      (void) !write(wake, &signal, sizeof(signal));
     }
+    if (local) udev_unref(local);
   }
 
-  auto CreateJoypad(udev_device *device, const string &device_node) -> void {
-    Joypad jp;
+  //appends every joypad the workers have finished probing
+  auto Publish() -> void {
+    vector<Joypad> ready;
+    vector<std::thread> finished;
+    {
+      std::lock_guard<std::mutex> guard(probeLock);
+      ready.swap(probed);
+      if (!probersRunning) finished.swap(probers);
+    }
+    for (auto &thread : finished) thread.join();
+    for (auto &jp : ready) AppendJoypad(jp);
+    if (!ready.empty()) {
+      std::lock_guard<std::mutex> guard(probeLock);
+      cache.Save();
+    }
+  }
+
+  //drops queued probes and waits for the ones in flight
+  auto CancelProbes() -> void {
+    vector<std::thread> workers;
+    {
+      std::lock_guard<std::mutex> guard(probeLock);
+      probes.erase(std::remove_if(probes.begin(), probes.end(), [](auto &probe) {
+        return !probe.started;
+      }), probes.end());
+      workers.swap(probers);
+    }
+    for (auto &thread : workers) thread.join();
+    std::lock_guard<std::mutex> guard(probeLock);
+    for (auto &jp : probed) close(jp.fd);
+    probed.clear();
+    probes.clear();
+    cache.Save();
+  }
+
+  //opens and inspects one device; jp.fd stays open only if it is a joypad.
+  //a matching cached entry replaces the capability ioctls and sysattr walk, in
+  //which case true is returned. runs on a probing thread, so it must not touch
+  //anything but jp
+  static auto CreateJoypad(udev_device *device, const string &device_node, Joypad &jp, const JoypadCache::Entry *cached = nullptr) -> bool {
     jp.deviceNode = device_node;
 
     struct stat st{};
-    if (stat(device_node.c_str(), &st) < 0) return;
+    if (stat(device_node.c_str(), &st) < 0) return false;
     jp.device = st.st_rdev;
 
     jp.fd = open(device_node.c_str(), O_RDWR | O_NONBLOCK);
-    if (jp.fd < 0) return;
+    if (jp.fd < 0) return false;
+
+    int clockID = clock;
+    jp.eventTime = ioctl(jp.fd, EVIOCSCLOCKID, &clockID) == 0;
+    ioctl(jp.fd, EVIOCGID, &jp.id);
+    if (cached && Restore(jp, *cached)) return true;
 
     // uint8_t evbit[(EV_MAX + 7) / 8] = {0};
     // uint8_t keybit[(KEY_MAX + 7) / 8] = {0};
@@ -250,35 +1099,32 @@ struct InputJoypadUdev {
       for (int i = 0; i < ABS_MISC; i++) {
         if (TEST_BIT(jp.absbit, i)) {
           if (i >= ABS_HAT0X && i <= ABS_HAT3Y) {
-            auto hat = jp.hats.insert({i, hats++});
-            if (hat.second) {
-              ioctl(jp.fd, EVIOCGABS(i), &hat.first->info);
-            }
+            jp.hats.emplace_back(i, hats++);
+            ioctl(jp.fd, EVIOCGABS(i), &jp.hats.back().info);
           } else {
-            auto axis = jp.axes.insert({i, axes++});
-            if (axis.second) {
-              ioctl(jp.fd, EVIOCGABS(i), &axis.first->info);
-            }
+            jp.axes.emplace_back(i, axes++);
+            ioctl(jp.fd, EVIOCGABS(i), &jp.axes.back().info);
           }
         }
       }
       for (int i = BTN_JOYSTICK; i < KEY_MAX; i++) {
         if (TEST_BIT(jp.keybit, i)) {
-          jp.buttons.insert({i, buttons++});
+          jp.buttons.emplace_back(i, buttons++);
         }
       }
       for (int i = BTN_MISC; i < BTN_JOYSTICK; i++) {
         if (TEST_BIT(jp.keybit, i)) {
-          jp.buttons.insert({i, buttons++});
+          jp.buttons.emplace_back(i, buttons++);
         }
       }
       jp.rumble = jp.effects >= 2 && TEST_BIT(jp.ffbit, FF_RUMBLE);
-
-      CreateJoypadHID(jp);
-      joypads.push_back(jp);
+    } else {
+      close(jp.fd);
+      jp.fd = -1;
     }
 
     #undef TEST_BIT
+    return false;
   }
 
   static auto CreateJoypadHID(Joypad &jp) -> void {
@@ -286,20 +1132,87 @@ struct InputJoypadUdev {
     jp.hid->SetProductID(std::stoi(jp.productID));
     jp.hid->SetPathID(Hash::CRC32::GetCRC32(jp.deviceName));
 
-    for (uint n = 0; n < jp.axes.size(); ++n) jp.hid->GetAxes().Append(std::to_string(n));
-    for (uint n = 0; n < jp.hats.size(); ++n) jp.hid->GetHats().Append(std::to_string(n));
-    for (uint n = 0; n < jp.buttons.size(); ++n) jp.hid->GetButtons().Append(std::to_string(n));
+    jp.hid->GetAxes().Resize(jp.axes.size());
+    jp.hid->GetHats().Resize(jp.hats.size());
+    jp.hid->GetButtons().Resize(jp.buttons.size());
     jp.hid->SetRumble(jp.rumble);
+
+    uint index = 0;
+    auto map = [&](JoypadCode &entry, uint group, const JoypadInput &source) {
+      entry.group = group;
+      entry.id = source.id;
+      entry.index = index++;
+      entry.SetRange(source.info.minimum, source.info.maximum);
+    };
+    for (auto &axis : jp.axes) map(jp.absolutes[axis.code], HID::Joypad::GroupID::Axis, axis);
+    for (auto &hat : jp.hats) map(jp.absolutes[hat.code], HID::Joypad::GroupID::Hat, hat);
+    for (auto &button : jp.buttons) map(jp.keys[button.code - BTN_MISC], HID::Joypad::GroupID::Button, button);
+    jp.staged.assign(index, 0);
+    jp.pending.reserve(index);
   }
 
-  auto RemoveJoypad(udev_device *, const string &device_node) -> void {
-    for (uint n = 0; n < joypads.size(); ++n) {
-      if (joypads[n].deviceNode == device_node) {
-        close(joypads[n].fd);
-        joypads.erase(joypads.begin() + n);
-        return;
-      }
+  auto LogDevice(const Joypad &jp) -> void {
+    if (recording < 0) return;
+    auto absolute = [&](const JoypadInput &input) {
+      log.Varint(input.code);
+      log.Zigzag(input.info.value);
+      log.Zigzag(input.info.minimum);
+      log.Zigzag(input.info.maximum);
+      log.Zigzag(input.info.fuzz);
+      log.Zigzag(input.info.flat);
+      log.Zigzag(input.info.resolution);
+    };
+    log.Byte(JoypadLog::Device);
+    log.Varint(jp.slot);
+    log.String(jp.deviceNode);
+    log.String(jp.name);
+    log.String(jp.deviceName);
+    log.String(jp.vendorID);
+    log.String(jp.productID);
+    log.Byte(jp.rumble);
+    log.Varint(jp.axes.size());
+    for (auto &axis : jp.axes) absolute(axis);
+    log.Varint(jp.hats.size());
+    for (auto &hat : jp.hats) absolute(hat);
+    log.Varint(jp.buttons.size());
+    for (auto &button : jp.buttons) log.Varint(button.code);
+    Flush(false);
+  }
+
+  auto LogRemove(const Joypad &jp) -> void {
+    if (recording < 0) return;
+    log.Byte(JoypadLog::Remove);
+    log.Varint(jp.slot);
+    Flush(false);
+  }
+
+  auto LogEvents(const Joypad &jp, const input_event *events, uint count) -> void {
+    if (recording < 0) return;
+    log.Byte(JoypadLog::Events);
+    log.Varint(jp.slot);
+    log.Varint(count);
+    for (uint n = 0; n < count; ++n) {
+      auto time = Timestamp(events[n]);
+      log.Zigzag(int64_t(time - logTime));
+      logTime = time;
+      log.Varint(events[n].type);
+      log.Varint(events[n].code);
+      log.Zigzag(events[n].value);
+    }
+    Flush(false);
+  }
+
+  auto Flush(bool force) -> void {
+    if (!force && log.buffer.size() < 65536) return;
+    auto data = log.buffer.data();
+    auto size = log.buffer.size();
+    while (size) {
+      auto written = write(recording, data, size);
+      if (written <= 0) break;
+      data += written;
+      size -= written;
     }
+    log.buffer.clear();
   }
 };
 
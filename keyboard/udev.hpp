@@ -0,0 +1,319 @@
+#ifndef KEYBOARD_UDEV_HPP_
+#define KEYBOARD_UDEV_HPP_
+
+#include <array>
+#include <cstring>
+#include "../hid.h"
+
+namespace sen {
+
+//every evdev keyboard is merged into one HID::Keyboard whose button n is key code n.
+//each keyboard keeps its key state as a KEY_CNT bit map, and the HID state is the
+//OR of all of them; only the 64-bit words touched since the last update are
+//compared, and differing keys are found with XOR and count-trailing-zeros
+struct InputKeyboardUdev {
+  Input &input;
+
+  explicit InputKeyboardUdev(Input &input) : input(input) {}
+
+  enum : uint { Words = KEY_CNT / 64 };
+  using KeyState = std::array<uint64_t, Words>;
+
+  struct Keyboard {
+    int fd = -1;
+    string deviceNode;
+    KeyState keys{};
+    bool dropped = false;
+    bool eventTime = true;  //false if EVIOCSCLOCKID failed: events carry another clock, so the read time is used
+  };
+
+  static constexpr clockid_t clock = CLOCK_MONOTONIC;  //of Input timestamps, selected with EVIOCSCLOCKID for every opened keyboard
+  int epoll = -1;  //the keyboards' descriptors; hotplug is reported by the owner, see Hotplug()
+  uint generation = 0;  //incremented whenever Devices() would report a different set
+  shared_ptr<HID::Keyboard> hid;
+  vector<Keyboard> keyboards;
+  KeyState keys{};      //merged state, mirrors the HID button values
+  uint32_t dirty = 0;   //words of some keyboard's state changed since the last Update()
+  uint64_t drops = 0;
+
+  auto Now() const -> uint64_t {
+    timespec now{};
+    clock_gettime(clock, &now);
+    return uint64_t(now.tv_sec) * 1'000'000'000 + uint64_t(now.tv_nsec);
+  }
+
+  auto Poll() -> void {
+    if (epoll < 0) return;
+    epoll_event ready[16];
+    int count = epoll_wait(epoll, ready, 16, 0);
+    for (int n = 0; n < count; ++n) {
+      if (auto kb = Find(ready[n].data.fd)) Read(*kb);
+    }
+  }
+
+  //a udev event for deviceNode, reported by the owner's monitor
+  auto Hotplug(const string &action, const string &deviceNode) -> void {
+    if (action == "add" && !Find(deviceNode.c_str())) OpenKeyboard(deviceNode.c_str());
+    if (action == "remove") RemoveKeyboard(deviceNode);
+  }
+
+  auto Devices(vector<shared_ptr<HID::Device>> &devs) -> void {
+    if (hid && !keyboards.empty()) devs.push_back(hid);
+  }
+
+  auto Read(Keyboard &kb) -> void {
+    input_event events[32];
+    int64_t length = 0;
+    do {
+      length = read(kb.fd, events, sizeof(events));
+      if (length <= 0) break;
+      Decode(kb, events, length / sizeof(input_event), kb.eventTime ? 0 : Now());
+    } while (length == sizeof(events));
+  }
+
+  //key repeats (value 2) leave the key pressed; after SYN_DROPPED every event is
+  //discarded up to the next SYN_REPORT, which resynchronizes from the kernel.
+  //received, when set, replaces the event times
+  auto Decode(Keyboard &kb, const input_event *events, uint count, uint64_t received = 0) -> void {
+    auto time = [&](const input_event &event) { return received ? received : Timestamp(event); };
+    uint64_t timestamp = 0;
+    for (uint n = 0; n < count; ++n) {
+      auto &event = events[n];
+      if (event.type == EV_SYN && event.code == SYN_DROPPED) {
+        if (!kb.dropped) drops++;
+        kb.dropped = true;
+        continue;
+      }
+      if (kb.dropped) {
+        if (event.type == EV_SYN && event.code == SYN_REPORT) Resync(kb), timestamp = time(event);
+        continue;
+      }
+      if (event.type != EV_KEY || event.code >= KEY_CNT) continue;
+      uint64_t bit = 1ull << event.code % 64;
+      auto &word = kb.keys[event.code / 64];
+      word = event.value ? word | bit : word & ~bit;
+      dirty |= 1u << event.code / 64;
+      timestamp = time(event);
+    }
+    Update(timestamp);
+  }
+
+  //reads the pressed keys from the kernel, e.g. after SYN_DROPPED or when the
+  //application regains focus; only words that differ are marked for Update()
+  auto Resync(Keyboard &kb) -> void {
+    kb.dropped = false;
+    if (kb.fd < 0) return;
+    KeyState state{};
+    if (ioctl(kb.fd, EVIOCGKEY(sizeof(state)), state.data()) < 0) return;
+    for (uint w = 0; w < Words; ++w) {
+      if (state[w] != kb.keys[w]) dirty |= 1u << w;
+    }
+    kb.keys = state;
+  }
+
+  auto Resync() -> void {
+    for (auto &kb : keyboards) Resync(kb);
+    Update(Now());
+  }
+
+  //merges the dirty words of every keyboard and reports each key that changed
+  auto Update(uint64_t timestamp) -> void {
+    if (!dirty || !hid) return;
+    auto &buttons = hid->GetButtons();
+    for (; dirty; dirty &= dirty - 1) {
+      uint w = __builtin_ctz(dirty);
+      uint64_t merged = 0;
+      for (auto &kb : keyboards) merged |= kb.keys[w];
+      for (uint64_t changed = merged ^ keys[w]; changed; changed &= changed - 1) {
+        uint code = w * 64 + __builtin_ctzll(changed);
+        int16_t value = merged >> code % 64 & 1;
+        input.DoChange(*hid, HID::Keyboard::GroupID::Button, code, !value, value, timestamp);
+        buttons.GetInput(code).SetValue(value);
+      }
+      keys[w] = merged;
+    }
+  }
+
+  static auto Timestamp(const input_event &event) -> uint64_t {
+    return uint64_t(event.input_event_sec) * 1'000'000'000 + uint64_t(event.input_event_usec) * 1'000;
+  }
+
+  auto Find(int fd) -> Keyboard * {
+    for (auto &kb : keyboards) {
+      if (kb.fd == fd) return &kb;
+    }
+    return nullptr;
+  }
+
+  //the keyboards present are enumerated through context, which the owner keeps;
+  //without one, keyboards are only added by AppendKeyboard() and Hotplug()
+  auto Initialize(udev *context) -> bool {
+    CreateKeyboardHID();
+
+    epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll < 0) return false;
+
+    if (udev_enumerate *enumerator = context ? udev_enumerate_new(context) : nullptr) {
+      udev_enumerate_add_match_property(enumerator, "ID_INPUT_KEYBOARD", "1");
+      udev_enumerate_scan_devices(enumerator);
+      for (auto iter = udev_enumerate_get_list_entry(enumerator); iter != nullptr; iter = udev_list_entry_get_next(iter)) {
+        udev_device *device = udev_device_new_from_syspath(context, udev_list_entry_get_name(iter));
+        if (!device) continue;
+        if (const char *deviceNode = udev_device_get_devnode(device)) OpenKeyboard(deviceNode);
+        udev_device_unref(device);
+      }
+      udev_enumerate_unref(enumerator);
+    }
+
+    return true;
+  }
+
+  auto Terminate() -> void {
+    for (auto &kb : keyboards) close(kb.fd);
+    keyboards.clear();
+    keys = {};
+    dirty = 0;
+    hid.reset();
+    generation++;
+    if (epoll >= 0) {
+      close(epoll);
+      epoll = -1;
+    }
+  }
+
+  //registers an opened, non-blocking evdev node and takes its current key state
+  auto AppendKeyboard(int fd, const string &deviceNode, bool eventTime = true) -> void {
+    if (!hid) CreateKeyboardHID();
+    if (keyboards.empty()) generation++;
+    keyboards.push_back({fd, deviceNode});
+    keyboards.back().eventTime = eventTime;
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+    Resync(keyboards.back());
+    Update(Now());
+  }
+
+  //keys still held on a removed keyboard are released
+  auto RemoveKeyboard(const string &deviceNode) -> void {
+    auto kb = std::find_if(keyboards.begin(), keyboards.end(), [&](auto &item) { return item.deviceNode == deviceNode; });
+    if (kb == keyboards.end()) return;
+    for (uint w = 0; w < Words; ++w) {
+      if (kb->keys[w]) dirty |= 1u << w;
+    }
+    epoll_ctl(epoll, EPOLL_CTL_DEL, kb->fd, nullptr);
+    close(kb->fd);
+    keyboards.erase(kb);
+    Update(Now());
+    if (keyboards.empty()) generation++;
+  }
+
+ private:
+  //the "input" subsystem also reports the parent inputN nodes; only eventN nodes are opened
+  auto OpenKeyboard(const char *deviceNode) -> void {
+    if (!strstr(deviceNode, "/event")) return;
+    int fd = open(deviceNode, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return;
+    int clockID = clock;
+    AppendKeyboard(fd, deviceNode, ioctl(fd, EVIOCSCLOCKID, &clockID) == 0);
+  }
+
+  auto Find(const char *deviceNode) -> Keyboard * {
+    for (auto &kb : keyboards) {
+      if (kb.deviceNode == deviceNode) return &kb;
+    }
+    return nullptr;
+  }
+
+  auto CreateKeyboardHID() -> void {
+    hid = std::make_shared<HID::Keyboard>();
+    hid->SetVendorID(HID::Keyboard::GenericVendorID);
+    hid->SetProductID(HID::Keyboard::GenericProductID);
+    hid->SetPathID(0);
+    hid->SetHandle({Handle::KeyboardIndex, Handle::Next()});
+    auto &buttons = hid->GetButtons();
+    for (uint code = 0; code < KEY_CNT; ++code) buttons.Append(KeyName(code));
+    keys = {};
+  }
+
+  //names used by mapping assignments; keys without one are named "Key<code>"
+  static auto KeyName(uint code) -> string {
+    static const char *letters[] = {
+      "Q", "W", "E", "R", "T", "Y", "U", "I", "O", "P",  //KEY_Q..KEY_P
+      "A", "S", "D", "F", "G", "H", "J", "K", "L",       //KEY_A..KEY_L
+      "Z", "X", "C", "V", "B", "N", "M",                 //KEY_Z..KEY_M
+    };
+    if (code >= KEY_1 && code <= KEY_9) return string(1, '1' + code - KEY_1);
+    if (code >= KEY_F1 && code <= KEY_F10) return "F" + std::to_string(code - KEY_F1 + 1);
+    if (code >= KEY_Q && code <= KEY_P) return letters[code - KEY_Q];
+    if (code >= KEY_A && code <= KEY_L) return letters[10 + code - KEY_A];
+    if (code >= KEY_Z && code <= KEY_M) return letters[19 + code - KEY_Z];
+    switch (code) {
+    case KEY_ESC: return "Escape";
+    case KEY_0: return "0";
+    case KEY_MINUS: return "Dash";
+    case KEY_EQUAL: return "Equal";
+    case KEY_BACKSPACE: return "Backspace";
+    case KEY_TAB: return "Tab";
+    case KEY_LEFTBRACE: return "LeftBracket";
+    case KEY_RIGHTBRACE: return "RightBracket";
+    case KEY_ENTER: return "Enter";
+    case KEY_LEFTCTRL: return "LeftControl";
+    case KEY_SEMICOLON: return "Semicolon";
+    case KEY_APOSTROPHE: return "Apostrophe";
+    case KEY_GRAVE: return "Tilde";
+    case KEY_LEFTSHIFT: return "LeftShift";
+    case KEY_BACKSLASH: return "Backslash";
+    case KEY_COMMA: return "Comma";
+    case KEY_DOT: return "Period";
+    case KEY_SLASH: return "Slash";
+    case KEY_RIGHTSHIFT: return "RightShift";
+    case KEY_KPASTERISK: return "Multiply";
+    case KEY_LEFTALT: return "LeftAlt";
+    case KEY_SPACE: return "Spacebar";
+    case KEY_CAPSLOCK: return "CapsLock";
+    case KEY_NUMLOCK: return "NumLock";
+    case KEY_SCROLLLOCK: return "ScrollLock";
+    case KEY_KP7: return "Keypad7";
+    case KEY_KP8: return "Keypad8";
+    case KEY_KP9: return "Keypad9";
+    case KEY_KPMINUS: return "Subtract";
+    case KEY_KP4: return "Keypad4";
+    case KEY_KP5: return "Keypad5";
+    case KEY_KP6: return "Keypad6";
+    case KEY_KPPLUS: return "Add";
+    case KEY_KP1: return "Keypad1";
+    case KEY_KP2: return "Keypad2";
+    case KEY_KP3: return "Keypad3";
+    case KEY_KP0: return "Keypad0";
+    case KEY_KPDOT: return "Point";
+    case KEY_F11: return "F11";
+    case KEY_F12: return "F12";
+    case KEY_KPENTER: return "KeypadEnter";
+    case KEY_RIGHTCTRL: return "RightControl";
+    case KEY_KPSLASH: return "Divide";
+    case KEY_SYSRQ: return "PrintScreen";
+    case KEY_RIGHTALT: return "RightAlt";
+    case KEY_HOME: return "Home";
+    case KEY_UP: return "Up";
+    case KEY_PAGEUP: return "PageUp";
+    case KEY_LEFT: return "Left";
+    case KEY_RIGHT: return "Right";
+    case KEY_END: return "End";
+    case KEY_DOWN: return "Down";
+    case KEY_PAGEDOWN: return "PageDown";
+    case KEY_INSERT: return "Insert";
+    case KEY_DELETE: return "Delete";
+    case KEY_PAUSE: return "Pause";
+    case KEY_LEFTMETA: return "LeftSuper";
+    case KEY_RIGHTMETA: return "RightSuper";
+    case KEY_COMPOSE: return "Menu";
+    }
+    return "Key" + std::to_string(code);
+  }
+};
+
+}
+
+#endif //KEYBOARD_UDEV_HPP_
@@ -1,3 +1,6 @@
+#include <chrono>
+#include <cstdio>
+
 #include "mapping.hpp"
 #include "hid.h"
 
@@ -70,6 +73,13 @@ auto split(const string &source, const string &find) -> vector<string> {
 }
 
 auto InputMapping::Bind() -> void {
+  if (!input_manager) return Resolve({});
+  input_manager->invalidate();
+  Resolve(input_manager->devices);
+}
+
+//resolves assignment ("device name/device ID/group name/input name[/Lo|Hi]")
+auto InputMapping::Resolve(const vector<shared_ptr<HID::Device>> &devices) -> void {
   device.reset();
   device_id = 0;
   group_id = 0;
@@ -77,41 +87,214 @@ auto InputMapping::Bind() -> void {
   qualifier = Qualifier::None;
 
   auto p = split(assignment, "/");
+  if (p.size() < 4) return;
+
+  uint64_t id = std::strtoull(p[1].c_str(), nullptr, 16);
+  for (auto &dev : devices) {
+    if (dev->GetName() != p[0] || dev->GetID() != id) continue;
+    auto group = dev->Find(p[2]);
+    if (group == uint(-1)) continue;
+    auto input = dev->GetGroup(group).Find(p[3]);
+    if (input == uint(-1)) continue;
 
-  if (p.size() >= 4) {
-    /*for (auto &dev : input_manager->devices) {
-      if (dev->GetName() == p[0]) {
-        if (dev->GetID() == std::stoi(p[1], nullptr, 16)) {
-
-          if (auto groupID = dev->find(p[2])) {
-            if (auto inputID = dev->group(*groupID).find(p[3])) {
-              this->device = dev;
-              this->deviceID = dev->id();
-              this->groupID = *groupID;
-              this->inputID = *inputID;
-              this->qualifier = Qualifier::None;
-              if (p.size() >= 5) {
-                if (p[4] == "Lo") this->qualifier = Qualifier::Lo;
-                if (p[4] == "Hi") this->qualifier = Qualifier::Hi;
-              }
-              break;
-            }
-          }
-        }
-      }
-    }*/
+    device = dev;
+    device_id = id;
+    group_id = group;
+    input_id = input;
+    if (p.size() >= 5) {
+      if (p[4] == "Lo") qualifier = Qualifier::Lo;
+      if (p[4] == "Hi") qualifier = Qualifier::Hi;
+    }
+    return;
   }
 }
+
 auto InputMapping::Unbind() -> void {
+  ResetAssignment();
+}
+
+auto InputMapping::Text() -> string {
+  if (!device) return assignment.empty() ? "(none)" : "(disconnected)";
+  auto text = device->GetGroup(group_id).GetInput(input_id).GetName();
+  if (qualifier == Qualifier::Lo) text += " Lo";
+  if (qualifier == Qualifier::Hi) text += " Hi";
+  return text;
+}
 
+auto InputMapping::Value() -> int16_t {
+  if (!device) return 0;
+  return Qualify(device->GetGroup(group_id).GetInput(input_id).GetValue());
 }
+
+auto InputMapping::Qualify(int16_t value) const -> int16_t {
+  if (qualifier == Qualifier::Lo) return value < -16384;
+  if (qualifier == Qualifier::Hi) return value > +16384;
+  return value;
+}
+
+auto InputMapping::ResetAssignment() -> void {
+  assignment.clear();
+  Bind();
+}
+
 auto InputMapping::SetAssignment(
-    shared_ptr<InputManager>,
-    shared_ptr<HID::Device>,
-    uint,
-    uint,
-    InputMapping::Qualifier) -> void {
+    shared_ptr<InputManager> manager,
+    shared_ptr<HID::Device> dev,
+    uint new_group_id,
+    uint new_input_id,
+    InputMapping::Qualifier new_qualifier) -> void {
+  char id[17];
+  snprintf(id, sizeof(id), "%016llx", (unsigned long long) dev->GetID());
+  assignment = dev->GetName() + "/" + id + "/" + dev->GetGroup(new_group_id).GetName() + "/"
+      + dev->GetGroup(new_group_id).GetInput(new_input_id).GetName();
+  if (new_qualifier == Qualifier::Lo) assignment += "/Lo";
+  if (new_qualifier == Qualifier::Hi) assignment += "/Hi";
+  input_manager = std::move(manager);
+  Bind();
+}
+
+InputManager::~InputManager() {
+  if (input) input->Unsubscribe(subscription);
+}
+
+auto InputManager::create(Input &source) -> void {
+  if (input) input->Unsubscribe(subscription);
+  input = &source;
+  subscription = input->Subscribe({}, [this](const InputChange &change) { eventInput(change); });
+}
+
+//re-resolves every assignment, for instance after the device set changed
+auto InputManager::bind() -> void {
+  for (auto mapping : mappings) mapping->Resolve(devices);
+  for (auto &hotkey : hotkeys) {
+    hotkey.Resolve(devices);
+    for (auto &key : hotkey.chord) key.Resolve(devices);
+    for (auto &step : hotkey.sequence) step.Resolve(devices);
+  }
+  invalidate();
+}
+
+auto InputManager::poll() -> void {
+  if (!input) return;
+  auto now = (uint64_t) std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  if (now - lastPoll < pollFrequency) return;
+  lastPoll = now;
+
+  input->Poll(devices);
+  if (devices != known) {
+    known = devices;
+    bind();
+  }
+}
+
+auto InputManager::append(InputMapping &mapping) -> void {
+  mapping.input_manager = weak_from_this().lock();
+  mappings.push_back(&mapping);
+  mapping.Bind();
+}
 
+auto InputManager::remove(InputMapping &mapping) -> void {
+  mappings.erase(std::remove(mappings.begin(), mappings.end(), &mapping), mappings.end());
+  invalidate();
 }
 
-}
\ No newline at end of file
+auto InputManager::appendHotkey(const string &name) -> InputHotkey & {
+  invalidate();
+  return hotkeys.emplace_back(name);
+}
+
+auto InputManager::removeHotkey(const InputHotkey &hotkey) -> bool {
+  for (auto item = hotkeys.begin(); item != hotkeys.end(); ++item) {
+    if (&*item != &hotkey) continue;
+    hotkeys.erase(item);
+    invalidate();
+    return true;
+  }
+  return false;
+}
+
+auto InputManager::findHotkey(const string &name) -> InputHotkey * {
+  for (auto &hotkey : hotkeys) {
+    if (hotkey.name == name) return &hotkey;
+  }
+  return nullptr;
+}
+
+auto InputManager::eventInput(shared_ptr<HID::Device> device, uint groupID, uint inputID, int16_t oldValue, int16_t newValue) -> void {
+  eventInput({device.get(), device->GetHandle(), uint16_t(groupID), uint16_t(inputID), oldValue, newValue, 0});
+}
+
+auto InputManager::eventInput(const InputChange &change) -> void {
+  if (!mapping_callback) return;
+  for (auto mapping : routes(change.handle, change.group, change.input)) {
+    auto oldValue = mapping->Qualify(change.old_value);
+    auto newValue = mapping->Qualify(change.new_value);
+    if (oldValue != newValue) mapping_callback(*mapping, oldValue, newValue);
+  }
+}
+
+auto InputManager::routes(Handle handle, uint groupID, uint inputID) -> InputRoutes {
+  if (dirty) compile();
+  auto n = index(handle, groupID, inputID);
+  if (n == Unrouted) return {};
+  return {targets.data() + offsets[n], targets.data() + offsets[n + 1]};
+}
+
+auto InputManager::index(Handle handle, uint groupID, uint inputID) const -> uint32_t {
+  const RouteDevice *device = nullptr;
+  if (handle.index < route_devices.size() && route_devices[handle.index].handle == handle) {
+    device = &route_devices[handle.index];
+  } else {
+    for (auto &item : route_collisions) {
+      if (item.handle == handle) device = &item;
+    }
+  }
+  if (!device || groupID + 1 >= device->groups.size()) return Unrouted;
+  auto n = device->groups[groupID] + inputID;
+  return n < device->groups[groupID + 1] ? n : Unrouted;
+}
+
+//counting sort of all bound mappings by input number
+auto InputManager::compile() -> void {
+  route_devices.clear();
+  route_collisions.clear();
+  uint32_t inputs = 0;
+  for (auto &device : devices) {
+    auto handle = device->GetHandle();
+    if (!handle) continue;
+    if (handle.index >= route_devices.size()) route_devices.resize(handle.index + 1);
+    auto *entry = &route_devices[handle.index];
+    if (entry->handle) entry = &route_collisions.emplace_back();
+    entry->handle = handle;
+    for (auto &group : *device) {
+      entry->groups.push_back(inputs);
+      inputs += group.size();
+    }
+    entry->groups.push_back(inputs);
+  }
+
+  vector<InputMapping*> bound = mappings;
+  for (auto &hotkey : hotkeys) bound.push_back(&hotkey);
+  auto number = [&](const InputMapping *mapping) -> uint32_t {
+    if (!mapping->device) return Unrouted;
+    return index(mapping->device->GetHandle(), mapping->group_id, mapping->input_id);
+  };
+
+  offsets.assign(inputs + 1, 0);
+  for (auto mapping : bound) {
+    auto n = number(mapping);
+    if (n != Unrouted) offsets[n + 1]++;
+  }
+  for (uint32_t n = 0; n < inputs; ++n) offsets[n + 1] += offsets[n];
+  targets.assign(offsets[inputs], nullptr);
+  auto next = offsets;
+  for (auto mapping : bound) {
+    auto n = number(mapping);
+    if (n != Unrouted) targets[next[n]++] = mapping;
+  }
+
+  dirty = false;
+}
+
+}
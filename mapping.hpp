@@ -1,6 +1,7 @@
 #ifndef MAPPING_HPP_
 #define MAPPING_HPP_
 
+#include <list>
 #include <utility>
 
 #include "input.hpp"
@@ -16,6 +17,7 @@ struct InputMapping {
 
   auto Bind(const shared_ptr<InputManager>&, const shared_ptr<HID::Device>&, uint, uint, int16_t, int16_t) -> bool;
   auto Bind() -> void;
+  auto Resolve(const vector<shared_ptr<HID::Device>> &devices) -> void;
   auto Unbind() -> void;
   // auto icon() -> image;
   auto Text() -> string;
@@ -23,6 +25,8 @@ struct InputMapping {
 
   auto ResetAssignment() -> void;
   auto SetAssignment(shared_ptr<InputManager>, shared_ptr<HID::Device>, uint, uint, Qualifier = Qualifier::None) -> void;
+  //applies the qualifier to a raw input value: Lo and Hi report 0 or 1
+  auto Qualify(int16_t value) const -> int16_t;
 
   const string name;
 
@@ -40,16 +44,30 @@ struct InputButton : InputMapping {
   using InputMapping::InputMapping;
 };
 
+//pressed while its own input and every chord input are held; with a sequence,
+//the sequence inputs must first be pressed in order, each within timeout
+//milliseconds of the previous one. changes take effect on InputManager::bind()
 struct InputHotkey : InputMapping {
   using InputMapping::InputMapping;
   auto& OnPress(function<void ()> press) { return press_callback = std::move(press), *this; }
   auto& OnRelease(function<void ()> release) { return release_callback = std::move(release), *this; }
+  auto& Chord(const string &key) { return chord.emplace_back(name).assignment = key, *this; }
+  auto& Sequence(const string &step) { return sequence.emplace_back(name).assignment = step, *this; }
+  auto& Timeout(uint64_t milliseconds) { return timeout = milliseconds, *this; }
+
+  vector<InputMapping> chord;
+  vector<InputMapping> sequence;
+  uint64_t timeout = 500;
 
  private:
   function<void ()> press_callback;
   function<void ()> release_callback;
   int16_t state = 0;
-  friend class InputManager;
+  bool armed = false;        //every input is bound
+  vector<uint32_t> steps;    //pressed bit of each sequence input
+  uint step = 0;             //sequence inputs matched so far
+  uint64_t deadline = 0;
+  friend struct InputManager;
 };
 
 struct VirtualPad {
@@ -64,21 +82,89 @@ struct VirtualPad {
   vector<InputMapping*> mappings;
 };
 
-struct InputManager {
-  auto create() -> void;
+//mappings bound to one input, see InputManager::routes()
+struct InputRoutes {
+  auto begin() const -> InputMapping *const * { return first; }
+  auto end() const -> InputMapping *const * { return last; }
+  auto size() const -> size_t { return last - first; }
+
+  InputMapping *const *first = nullptr;
+  InputMapping *const *last = nullptr;
+};
+
+struct InputManager : std::enable_shared_from_this<InputManager> {
+  ~InputManager();
+
+  //subscribes to every change of input, which must outlive the manager
+  auto create(Input &input) -> void;
   auto bind() -> void;
   auto poll() -> void;
   auto eventInput(shared_ptr<HID::Device>, uint groupID, uint inputID, int16_t oldValue, int16_t newValue) -> void;
+  auto eventInput(const InputChange &change) -> void;
+
+  //registers a mapping; it must outlive the manager or be removed first
+  auto append(InputMapping &mapping) -> void;
+  auto remove(InputMapping &mapping) -> void;
+  auto onMapping(function<void (InputMapping &, int16_t oldValue, int16_t newValue)> callback) -> void { mapping_callback = std::move(callback); }
+
+  //the mappings bound to an input, from the compiled dispatch table
+  auto routes(Handle handle, uint groupID, uint inputID) -> InputRoutes;
+  //forces the table to be rebuilt; called whenever an assignment changes
+  auto invalidate() -> void { dirty = hotkeys_dirty = true; }
+
+  //a hotkey stays at its address until it is removed
+  auto appendHotkey(const string &name) -> InputHotkey &;
+  auto removeHotkey(const InputHotkey &hotkey) -> bool;
+  auto findHotkey(const string &name) -> InputHotkey *;
 
   //hotkeys.cpp
   auto createHotkeys() -> void;
   auto pollHotkeys() -> void;
+  //now in milliseconds, on the clock the sequence timeouts are measured with
+  auto pollHotkeys(uint64_t now) -> void;
 
   vector<shared_ptr<HID::Device>> devices;
-  vector<InputHotkey> hotkeys;
+  vector<InputMapping*> mappings;
 
   uint64_t pollFrequency = 5;
   uint64_t lastPoll = 0;
+
+ private:
+  auto compile() -> void;
+  auto index(Handle handle, uint groupID, uint inputID) const -> uint32_t;
+
+  //dispatch table: all inputs of all devices are numbered consecutively, and the
+  //mappings bound to input n are targets[offsets[n], offsets[n + 1]).
+  //RouteDevice::groups holds the number of each group's first input, plus one
+  //past the last; devices are indexed by Handle::index, and the few whose index
+  //is taken by a device of another registry are searched in route_collisions
+  struct RouteDevice {
+    Handle handle;
+    vector<uint32_t> groups;
+  };
+  enum : uint32_t { Unrouted = ~0u };
+  vector<RouteDevice> route_devices;
+  vector<RouteDevice> route_collisions;
+  vector<uint32_t> offsets;
+  vector<InputMapping*> targets;
+  bool dirty = true;
+
+  //hotkeys.cpp: every distinct hotkey input owns one bit of the pressed set, and
+  //hotkey n is held while all bits of masks[n * words, (n + 1) * words) are set
+  auto compileHotkeys() -> void;
+  std::list<InputHotkey> hotkeys;
+  vector<InputMapping> hotkey_inputs;
+  vector<uint64_t> hotkey_pressed;
+  vector<uint64_t> hotkey_sampled;
+  vector<uint64_t> hotkey_rising;
+  vector<uint64_t> hotkey_masks;
+  uint hotkey_words = 0;
+  bool hotkeys_dirty = true;
+
+  Input *input = nullptr;
+  uint subscription = 0;
+  vector<shared_ptr<HID::Device>> known;
+  function<void (InputMapping &, int16_t, int16_t)> mapping_callback;
 };
 
 }
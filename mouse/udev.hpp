@@ -0,0 +1,312 @@
+#ifndef MOUSE_UDEV_HPP_
+#define MOUSE_UDEV_HPP_
+
+#include <cstring>
+#include "../hid.h"
+
+namespace sen {
+
+//every evdev mouse is merged into one HID::Mouse. relative motion is summed per
+//report (SYN_REPORT) and the reports per Poll(), so the X, Y and Z (wheel) axes
+//change at most once per poll however fast the mouse reports; the reports
+//themselves can be kept in an optional motion history. buttons are the OR of
+//all mice, and change as soon as they are decoded
+struct InputMouseUdev {
+  Input &input;
+
+  explicit InputMouseUdev(Input &input) : input(input) {}
+
+  enum Axis : uint { X, Y, Z, Axes };
+  enum : uint { Buttons = BTN_TASK - BTN_LEFT + 1 };
+
+  struct Mouse {
+    int fd = -1;
+    string deviceNode;
+    int32_t report[Axes] = {};  //motion of the report being decoded
+    uint8_t buttons = 0;
+    bool dropped = false;
+    bool eventTime = true;  //false if EVIOCSCLOCKID failed: events carry another clock, so the read time is used
+  };
+
+  static constexpr clockid_t clock = CLOCK_MONOTONIC;  //of Input timestamps, selected with EVIOCSCLOCKID for every opened mouse
+  int epoll = -1;
+  uint generation = 0;  //incremented whenever Devices() would report a different set
+  shared_ptr<HID::Mouse> hid;
+  vector<Mouse> mice;
+  int64_t motion[Axes] = {};  //sum of the reports decoded since the last Flush()
+  uint64_t timestamp = 0;     //of the last report
+  uint8_t buttons = 0;        //merged state, mirrors the HID button values
+  bool acquired = false;
+  uint64_t drops = 0;
+
+  //ring of the reports decoded by the last Poll(); capacity 0 disables it
+  vector<InputMotion> history;
+  uint historyHead = 0;
+  uint historyCount = 0;
+
+  auto Now() const -> uint64_t {
+    timespec now{};
+    clock_gettime(clock, &now);
+    return uint64_t(now.tv_sec) * 1'000'000'000 + uint64_t(now.tv_nsec);
+  }
+
+  //the axes return to 0 on every poll, so Flush() runs even when no mouse is
+  //ready; ready = false skips the epoll_wait when the owner knows the set is idle
+  auto Poll(bool ready = true) -> void {
+    historyCount = 0;
+    if (ready && epoll >= 0) {
+      epoll_event events[16];
+      int count = epoll_wait(epoll, events, 16, 0);
+      for (int n = 0; n < count; ++n) {
+        if (auto mouse = Find(events[n].data.fd)) Read(*mouse);
+      }
+    }
+    Flush();
+  }
+
+  //a udev event for deviceNode, reported by the owner's monitor
+  auto Hotplug(const string &action, const string &deviceNode) -> void {
+    if (action == "add" && !Find(deviceNode.c_str())) OpenMouse(deviceNode.c_str());
+    if (action == "remove") RemoveMouse(deviceNode);
+  }
+
+  auto Devices(vector<shared_ptr<HID::Device>> &devs) -> void {
+    if (hid && !mice.empty()) devs.push_back(hid);
+  }
+
+  auto Read(Mouse &mouse) -> void {
+    input_event events[64];
+    int64_t length = 0;
+    do {
+      length = read(mouse.fd, events, sizeof(events));
+      if (length <= 0) break;
+      Decode(mouse, events, length / sizeof(input_event), mouse.eventTime ? 0 : Now());
+    } while (length == sizeof(events));
+  }
+
+  //after SYN_DROPPED the partial report is discarded along with every event up to
+  //the next SYN_REPORT; the buttons are then read back from the kernel.
+  //received, when set, replaces the event times
+  auto Decode(Mouse &mouse, const input_event *events, uint count, uint64_t received = 0) -> void {
+    auto time = [&](const input_event &event) { return received ? received : Timestamp(event); };
+    for (uint n = 0; n < count; ++n) {
+      auto &event = events[n];
+      if (event.type == EV_SYN && event.code == SYN_DROPPED) {
+        if (!mouse.dropped) drops++;
+        mouse.dropped = true;
+        std::fill(std::begin(mouse.report), std::end(mouse.report), 0);
+        continue;
+      }
+      if (mouse.dropped) {
+        if (event.type == EV_SYN && event.code == SYN_REPORT) Resync(mouse, time(event));
+        continue;
+      }
+      if (event.type == EV_REL) {
+        if (event.code == REL_X) mouse.report[X] += event.value;
+        if (event.code == REL_Y) mouse.report[Y] += event.value;
+        if (event.code == REL_WHEEL) mouse.report[Z] += event.value;
+      } else if (event.type == EV_KEY && event.code >= BTN_LEFT && event.code <= BTN_TASK) {
+        uint8_t bit = 1 << (event.code - BTN_LEFT);
+        mouse.buttons = event.value ? mouse.buttons | bit : mouse.buttons & ~bit;
+        Update(time(event));
+      } else if (event.type == EV_SYN && event.code == SYN_REPORT) {
+        Report(mouse, time(event));
+      }
+    }
+  }
+
+  auto Report(Mouse &mouse, uint64_t time) -> void {
+    auto &report = mouse.report;
+    if (!report[X] && !report[Y] && !report[Z]) return;
+    for (uint axis = 0; axis < Axes; ++axis) motion[axis] += report[axis];
+    timestamp = time;
+    if (!history.empty()) {
+      history[(historyHead + historyCount) % history.size()] = {report[X], report[Y], report[Z], time};
+      if (historyCount < history.size()) historyCount++;
+      else historyHead = (historyHead + 1) % history.size();
+    }
+    std::fill(std::begin(report), std::end(report), 0);
+  }
+
+  auto Resync(Mouse &mouse, uint64_t time) -> void {
+    mouse.dropped = false;
+    if (mouse.fd < 0) return;
+    uint8_t keys[(KEY_MAX + 7) / 8] = {0};
+    if (ioctl(mouse.fd, EVIOCGKEY(sizeof(keys)), keys) < 0) return;
+    mouse.buttons = 0;
+    for (uint n = 0; n < Buttons; ++n) {
+      uint code = BTN_LEFT + n;
+      if (keys[code >> 3] & 1 << (code & 7)) mouse.buttons |= 1 << n;
+    }
+    Update(time);
+  }
+
+  auto Resync() -> void {
+    for (auto &mouse : mice) Resync(mouse, Now());
+  }
+
+  //reports each button whose merged state changed
+  auto Update(uint64_t time) -> void {
+    if (!hid) return;
+    uint8_t merged = 0;
+    for (auto &mouse : mice) merged |= mouse.buttons;
+    auto &group = hid->GetButtons();
+    for (uint changed = merged ^ buttons; changed; changed &= changed - 1) {
+      uint id = __builtin_ctz(changed);
+      int16_t value = merged >> id & 1;
+      input.DoChange(*hid, HID::Mouse::GroupID::Button, id, !value, value, time);
+      group.GetInput(id).SetValue(value);
+    }
+    buttons = merged;
+  }
+
+  //hands the motion summed since the last call to the axes; an axis without
+  //motion returns to 0
+  auto Flush() -> void {
+    if (!hid) return;
+    auto values = hid->GetAxes().GetValues();
+    for (uint axis = 0; axis < Axes; ++axis) {
+      int16_t value = sclamp<16>(motion[axis]);
+      motion[axis] = 0;
+      if (value == values[axis]) continue;
+      input.DoChange(*hid, HID::Mouse::GroupID::Axis, axis, values[axis], value, value ? timestamp : 0);
+      values[axis] = value;
+    }
+  }
+
+  //the reports of the last Poll(), oldest first
+  auto Motion(vector<InputMotion> &samples) -> void {
+    samples.clear();
+    for (uint n = 0; n < historyCount; ++n) samples.push_back(history[(historyHead + n) % history.size()]);
+  }
+
+  auto SetMotionHistory(uint samples) -> bool {
+    history.assign(samples, InputMotion{});
+    historyHead = historyCount = 0;
+    return true;
+  }
+
+  static auto Timestamp(const input_event &event) -> uint64_t {
+    return uint64_t(event.input_event_sec) * 1'000'000'000 + uint64_t(event.input_event_usec) * 1'000;
+  }
+
+  auto Find(int fd) -> Mouse * {
+    for (auto &mouse : mice) {
+      if (mouse.fd == fd) return &mouse;
+    }
+    return nullptr;
+  }
+
+  //grabbing keeps the mice's events from every other reader, including the console
+  auto Acquire() -> bool {
+    acquired = true;
+    bool grabbed = true;
+    for (auto &mouse : mice) grabbed &= ioctl(mouse.fd, EVIOCGRAB, 1) == 0;
+    return grabbed;
+  }
+
+  auto Release() -> bool {
+    acquired = false;
+    bool released = true;
+    for (auto &mouse : mice) released &= ioctl(mouse.fd, EVIOCGRAB, 0) == 0;
+    return released;
+  }
+
+  auto Acquired() const -> bool { return acquired; }
+
+  //context is the owner's, used only for the initial scan; null skips it
+  auto Initialize(udev *context) -> bool {
+    CreateMouseHID();
+
+    epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll < 0) return false;
+
+    if (udev_enumerate *enumerator = context ? udev_enumerate_new(context) : nullptr) {
+      udev_enumerate_add_match_property(enumerator, "ID_INPUT_MOUSE", "1");
+      udev_enumerate_scan_devices(enumerator);
+      for (auto iter = udev_enumerate_get_list_entry(enumerator); iter != nullptr; iter = udev_list_entry_get_next(iter)) {
+        udev_device *device = udev_device_new_from_syspath(context, udev_list_entry_get_name(iter));
+        if (!device) continue;
+        if (const char *deviceNode = udev_device_get_devnode(device)) OpenMouse(deviceNode);
+        udev_device_unref(device);
+      }
+      udev_enumerate_unref(enumerator);
+    }
+
+    return true;
+  }
+
+  auto Terminate() -> void {
+    if (acquired) Release();
+    for (auto &mouse : mice) close(mouse.fd);
+    mice.clear();
+    std::fill(std::begin(motion), std::end(motion), 0);
+    buttons = 0;
+    historyCount = 0;
+    hid.reset();
+    generation++;
+    if (epoll >= 0) {
+      close(epoll);
+      epoll = -1;
+    }
+  }
+
+  //registers an opened, non-blocking evdev node; it is grabbed while acquired
+  auto AppendMouse(int fd, const string &deviceNode, bool eventTime = true) -> void {
+    if (!hid) CreateMouseHID();
+    if (mice.empty()) generation++;
+    mice.push_back({fd, deviceNode});
+    mice.back().eventTime = eventTime;
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+    if (acquired) ioctl(fd, EVIOCGRAB, 1);
+    Resync(mice.back(), Now());
+  }
+
+  //buttons still held on a removed mouse are released
+  auto RemoveMouse(const string &deviceNode) -> void {
+    auto mouse = std::find_if(mice.begin(), mice.end(), [&](auto &item) { return item.deviceNode == deviceNode; });
+    if (mouse == mice.end()) return;
+    epoll_ctl(epoll, EPOLL_CTL_DEL, mouse->fd, nullptr);
+    close(mouse->fd);
+    mice.erase(mouse);
+    Update(Now());
+    if (mice.empty()) generation++;
+  }
+
+ private:
+  //the "input" subsystem also reports the parent inputN and legacy mouseN nodes;
+  //only eventN nodes are opened
+  auto OpenMouse(const char *deviceNode) -> void {
+    if (!strstr(deviceNode, "/event")) return;
+    int fd = open(deviceNode, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return;
+    int clockID = clock;
+    AppendMouse(fd, deviceNode, ioctl(fd, EVIOCSCLOCKID, &clockID) == 0);
+  }
+
+  auto Find(const char *deviceNode) -> Mouse * {
+    for (auto &mouse : mice) {
+      if (mouse.deviceNode == deviceNode) return &mouse;
+    }
+    return nullptr;
+  }
+
+  auto CreateMouseHID() -> void {
+    static const char *names[Buttons] = {"Left", "Right", "Middle", "Side", "Extra", "Forward", "Back", "Task"};
+    hid = std::make_shared<HID::Mouse>();
+    hid->SetVendorID(HID::Mouse::GenericVendorID);
+    hid->SetProductID(HID::Mouse::GenericProductID);
+    hid->SetPathID(0);
+    hid->SetHandle({Handle::MouseIndex, Handle::Next()});
+    for (auto name : {"X", "Y", "Z"}) hid->GetAxes().Append(name);
+    for (auto name : names) hid->GetButtons().Append(name);
+    buttons = 0;
+  }
+};
+
+}
+
+#endif //MOUSE_UDEV_HPP_
@@ -0,0 +1,171 @@
+#ifndef REPLAY_HPP_
+#define REPLAY_HPP_
+
+#ifdef INPUT_UDEV
+
+#include <sys/mman.h>
+
+#include "joypad/udev.hpp"
+
+namespace sen {
+
+//plays back a capture written by Input::Record() through the udev joypad decoder.
+//realtime replays events at their recorded pace; otherwise every Poll() replays
+//as much as possible, stopping only at device changes so that callers observe them
+struct InputReplay : InputDriver {
+  explicit InputReplay(Input &super) : InputDriver(super), joypad(super) {}
+  ~InputReplay() override { Close(); }
+
+  auto Driver() -> string override { return "Replay"; }
+  auto Ready() -> bool override { return data_ != nullptr; }
+
+  auto HasCoalesced() -> bool override { return true; }
+
+  auto SetCoalesced(bool coalesced) -> bool override {
+    return joypad.SetCoalesced(coalesced);
+  }
+
+  auto Replay(const string &path, bool realtime) -> bool override {
+    Close();
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(JoypadLog::Magic)) {
+      close(fd);
+      return false;
+    }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    data_ = (const uint8_t *) data;
+    size_ = st.st_size;
+    if (memcmp(data_, JoypadLog::Magic, sizeof(JoypadLog::Magic)) != 0) return Close(), false;
+    reader_ = {data_ + sizeof(JoypadLog::Magic), size_ - sizeof(JoypadLog::Magic)};
+    if (reader_.Varint() != JoypadLog::Version) return Close(), false;
+    realtime_ = realtime;
+    return true;
+  }
+
+  auto Poll(vector<shared_ptr<HID::Device>> &devices) -> void override {
+    if (data_) Advance();
+    Publish(devices, joypad.generation, [&](auto &found) { joypad.Devices(found); });
+  }
+
+  //true once every record has been replayed
+  auto Finished() const -> bool { return !data_ || !reader_.ok || reader_.Empty(); }
+
+ private:
+  auto Advance() -> void {
+    auto now = joypad.Now();
+    if (!start_) start_ = now;
+
+    bool replayed = false;
+    while (!Finished()) {
+      auto next = reader_;
+      auto tag = next.Byte();
+      if (tag == JoypadLog::Events) {
+        if (realtime_) {
+          next.Varint();
+          if (next.Varint()) {
+            auto time = time_ + next.Zigzag();
+            if (!origin_) origin_ = time;
+            if (time - origin_ > now - start_) return;
+          }
+        }
+        reader_.Byte();
+        ReplayEvents();
+        replayed = true;
+      } else if (tag == JoypadLog::Device || tag == JoypadLog::Remove) {
+        if (!realtime_ && replayed) return;
+        reader_.Byte();
+        tag == JoypadLog::Device ? ReplayDevice() : ReplayRemove();
+      } else {
+        reader_.ok = false;
+      }
+    }
+  }
+
+  auto ReplayDevice() -> void {
+    InputJoypadUdev::Joypad jp;
+    auto absolute = [&](vector<InputJoypadUdev::JoypadInput> &inputs, uint id) {
+      inputs.emplace_back(int(reader_.Varint()), id);
+      auto &info = inputs.back().info;
+      info.value = reader_.Zigzag();
+      info.minimum = reader_.Zigzag();
+      info.maximum = reader_.Zigzag();
+      info.fuzz = reader_.Zigzag();
+      info.flat = reader_.Zigzag();
+      info.resolution = reader_.Zigzag();
+    };
+    uint slot = reader_.Varint();
+    jp.deviceNode = reader_.String();
+    jp.name = reader_.String();
+    jp.deviceName = reader_.String();
+    jp.vendorID = reader_.String();
+    jp.productID = reader_.String();
+    jp.rumble = reader_.Byte();
+    for (uint n = 0, count = reader_.Varint(); n < count && reader_.ok; ++n) absolute(jp.axes, n);
+    for (uint n = 0, count = reader_.Varint(); n < count && reader_.ok; ++n) absolute(jp.hats, n);
+    for (uint n = 0, count = reader_.Varint(); n < count && reader_.ok; ++n) jp.buttons.emplace_back(int(reader_.Varint()), n);
+    if (!reader_.ok) return;
+
+    jp.rumble = false;  //there is no device to play effects on
+    joypad.AppendJoypad(jp).slot = slot;
+  }
+
+  auto ReplayRemove() -> void {
+    if (auto jp = Find(reader_.Varint())) joypad.RemoveJoypad(nullptr, string(jp->deviceNode));
+  }
+
+  auto ReplayEvents() -> void {
+    auto jp = Find(reader_.Varint());
+    uint count = reader_.Varint();
+    input_event events[64];
+    while (count && reader_.ok) {
+      uint length = std::min(count, 64u);
+      for (uint n = 0; n < length; ++n) {
+        time_ += reader_.Zigzag();
+        events[n].input_event_sec = time_ / 1'000'000'000;
+        events[n].input_event_usec = time_ % 1'000'000'000 / 1'000;
+        events[n].type = reader_.Varint();
+        events[n].code = reader_.Varint();
+        events[n].value = int32_t(reader_.Zigzag());
+      }
+      if (jp && reader_.ok) joypad.Decode(*jp, events, length);
+      count -= length;
+    }
+  }
+
+  auto Find(uint slot) -> InputJoypadUdev::Joypad * {
+    for (auto &jp : joypad.joypads) {
+      if (jp.slot == slot) return &jp;
+    }
+    return nullptr;
+  }
+
+  //the devices of the previous capture go with it
+  auto Close() -> void {
+    joypad.Terminate();
+    if (data_) munmap((void *) data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+    reader_ = {};
+    start_ = origin_ = time_ = 0;
+  }
+
+  InputJoypadUdev joypad;
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+  JoypadLog::Reader reader_;
+  bool realtime_ = false;
+  uint64_t start_ = 0;   //local time the replay started
+  uint64_t origin_ = 0;  //recorded time of the first event
+  uint64_t time_ = 0;    //recorded time of the last decoded event
+};
+
+}
+
+#endif
+
+#endif //REPLAY_HPP_
@@ -0,0 +1,149 @@
+#ifndef SYNTHETIC_HPP_
+#define SYNTHETIC_HPP_
+
+#ifdef INPUT_UDEV
+
+#include "joypad/udev.hpp"
+
+namespace sen {
+
+//load generator: simulated joypads whose evdev reports are produced at a fixed
+//rate and decoded by the udev joypad backend, so consumers see the same
+//HID::Joypad objects and DoChange() traffic as with real hardware
+struct InputSynthetic : InputDriver {
+  explicit InputSynthetic(Input &super) : InputDriver(super), joypad(super) {}
+  ~InputSynthetic() override { joypad.Terminate(); }
+
+  auto Create() -> bool override {
+    return Simulate(vector<InputSimulation>(4, InputSimulation{}));
+  }
+
+  auto Driver() -> string override { return "Synthetic"; }
+
+  auto HasCoalesced() -> bool override { return true; }
+
+  auto SetCoalesced(bool coalesced) -> bool override {
+    return joypad.SetCoalesced(coalesced);
+  }
+
+  //an impossible layout anywhere in simulations leaves the current devices running
+  auto Simulate(const vector<InputSimulation> &simulations) -> bool override {
+    for (auto &simulation : simulations) {
+      if (simulation.axes > ABS_HAT0X || simulation.hats > 8 || simulation.buttons > KEY_CNT - BTN_JOYSTICK) return false;
+    }
+    joypad.Terminate();
+    devices.clear();
+    for (uint n = 0; n < simulations.size(); ++n) {
+      auto &simulation = simulations[n];
+
+      InputJoypadUdev::Joypad jp;
+      jp.deviceNode = "synthetic" + std::to_string(n);
+      jp.deviceName = jp.deviceNode;
+      jp.vendorID = "0000";
+      jp.productID = "0003";
+      for (uint id = 0; id < simulation.axes; ++id) {
+        jp.axes.emplace_back(ABS_X + id, id);
+        jp.axes.back().info.minimum = -32768;
+        jp.axes.back().info.maximum = +32767;
+      }
+      for (uint id = 0; id < simulation.hats; ++id) {
+        jp.hats.emplace_back(ABS_HAT0X + id, id);
+        jp.hats.back().info.minimum = -1;
+        jp.hats.back().info.maximum = +1;
+      }
+      for (uint id = 0; id < simulation.buttons; ++id) jp.buttons.emplace_back(BTN_JOYSTICK + id, id);
+      Device device;
+      device.handle = joypad.AppendJoypad(jp).handle;
+      device.simulation = simulation;
+      device.seed = 0x9e3779b9u * (n + 1);
+      devices.push_back(device);
+    }
+    last = 0;
+    return true;
+  }
+
+  auto Poll(vector<shared_ptr<HID::Device>> &list) -> void override {
+    Generate();
+    Publish(list, joypad.generation, [&](auto &found) { joypad.Devices(found); });
+  }
+
+  auto Statistics(uint64_t id) -> InputStatistics override {
+    return joypad.Statistics(id);
+  }
+
+  auto Statistics(Handle handle) -> InputStatistics override {
+    return joypad.Statistics(handle);
+  }
+
+ private:
+  struct Device {
+    InputSimulation simulation;
+    Handle handle;
+    uint32_t seed = 0;
+    double pending = 0;  //fractional reports carried over between polls
+  };
+
+  //emits one report per 1/rate seconds of elapsed time; a stalled caller gets
+  //at most a quarter second worth of reports
+  auto Generate() -> void {
+    auto now = joypad.Now();
+    if (!last) last = now;
+    auto elapsed = std::min<uint64_t>(now - last, 250'000'000);
+    last = now;
+
+    input_event events[64];
+    for (auto &device : devices) {
+      auto jp = joypad.Find(device.handle);
+      if (!jp) continue;
+      auto &simulation = device.simulation;
+      device.pending += elapsed * 1e-9 * simulation.rate;
+      uint reports = uint(device.pending);
+      device.pending -= reports;
+
+      uint length = 0;
+      for (uint report = 0; report < reports; ++report) {
+        uint64_t time = now - elapsed + elapsed * (report + 1) / reports;
+        auto random = Next(device.seed);
+        if (simulation.axes) {
+          Append(events[length++], time, EV_ABS, ABS_X + random % simulation.axes, int16_t(random >> 8));
+        }
+        if (simulation.hats && (random >> 4) % 16 == 0) {
+          Append(events[length++], time, EV_ABS, ABS_HAT0X + (random >> 12) % simulation.hats, int(random >> 16) % 3 - 1);
+        }
+        if (simulation.buttons && (random >> 2) % 4 == 0) {
+          Append(events[length++], time, EV_KEY, BTN_JOYSTICK + (random >> 20) % simulation.buttons, random >> 31);
+        }
+        Append(events[length++], time, EV_SYN, SYN_REPORT, 0);
+        if (length > 64 - 4 || report + 1 == reports) {
+          joypad.Decode(*jp, events, length, now);
+          length = 0;
+        }
+      }
+    }
+  }
+
+  static auto Append(input_event &event, uint64_t time, uint16_t type, uint16_t code, int32_t value) -> void {
+    event.input_event_sec = time / 1'000'000'000;
+    event.input_event_usec = time % 1'000'000'000 / 1'000;
+    event.type = type;
+    event.code = code;
+    event.value = value;
+  }
+
+  static auto Next(uint32_t &seed) -> uint32_t {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+  }
+
+  InputJoypadUdev joypad;
+  vector<Device> devices;
+  uint64_t last = 0;
+};
+
+}
+
+#endif
+
+#endif //SYNTHETIC_HPP_
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include "common.hpp"
+#include "input.hpp"
+#include "joypad/udev.hpp"
+
+namespace {
+
+auto CreateJoypad() -> sen::InputJoypadUdev::Joypad {
+  sen::InputJoypadUdev::Joypad jp;
+  jp.id = {BUS_USB, 0x045e, 0x028e, 0x0114};
+  jp.name = "Pad";
+  jp.deviceName = "/devices/pci0000:00/0000:00:14.0/usb1/1-2";
+  jp.vendorID = "045e";
+  jp.productID = "028e";
+  jp.serial = "0001";
+  jp.rumble = true;
+  jp.axes.emplace_back(ABS_X, 0);
+  jp.axes.back().info.minimum = -32768;
+  jp.axes.back().info.maximum = +32767;
+  jp.axes.back().info.flat = 128;
+  jp.hats.emplace_back(ABS_HAT0X, 0);
+  jp.hats.back().info.minimum = -1;
+  jp.hats.back().info.maximum = +1;
+  jp.buttons.emplace_back(BTN_SOUTH, 0);
+  jp.buttons.emplace_back(BTN_EAST, 1);
+  return jp;
+}
+
+}
+
+TEST(CacheTest, RestoresSavedLayouts) {
+  auto path = testing::TempDir() + "input-cache.bin";
+  unlink(path.c_str());
+  auto original = CreateJoypad();
+  {
+    sen::JoypadCache cache;
+    ASSERT_TRUE(cache.Load(path));  //a missing file is an empty cache
+    cache.Store(sen::InputJoypadUdev::Capture(original, "045e:028e:pci-0000:00:14.0-usb-0:2:1.0:0001"));
+    ASSERT_TRUE(cache.Save());
+  }
+
+  sen::JoypadCache cache;
+  ASSERT_TRUE(cache.Load(path));
+  auto entry = cache.Find("045e:028e:pci-0000:00:14.0-usb-0:2:1.0:0001");
+  ASSERT_NE(entry, nullptr);
+
+  sen::InputJoypadUdev::Joypad jp;
+  jp.id = original.id;
+  ASSERT_TRUE(sen::InputJoypadUdev::Restore(jp, *entry));
+  EXPECT_EQ(jp.deviceName, original.deviceName);
+  EXPECT_EQ(jp.serial, original.serial);
+  EXPECT_TRUE(jp.rumble);
+  ASSERT_EQ(jp.axes.size(), 1u);
+  EXPECT_EQ(jp.axes[0].code, ABS_X);
+  EXPECT_EQ(jp.axes[0].info.maximum, 32767);
+  EXPECT_EQ(jp.axes[0].info.flat, 128);
+  ASSERT_EQ(jp.hats.size(), 1u);
+  ASSERT_EQ(jp.buttons.size(), 2u);
+  EXPECT_EQ(jp.buttons[1].code, BTN_EAST);
+  EXPECT_EQ(jp.buttons[1].id, 1u);
+
+  //a firmware update changes the version and invalidates the entry
+  sen::InputJoypadUdev::Joypad updated;
+  updated.id = original.id;
+  updated.id.version++;
+  EXPECT_FALSE(sen::InputJoypadUdev::Restore(updated, *entry));
+  unlink(path.c_str());
+}
+
+TEST(CacheTest, RejectsForeignFiles) {
+  auto path = testing::TempDir() + "input-cache-foreign.bin";
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ASSERT_GE(fd, 0);
+  (void) !write(fd, "not a cache", 11);
+  close(fd);
+  sen::JoypadCache cache;
+  EXPECT_FALSE(cache.Load(path));
+  EXPECT_TRUE(cache.entries.empty());
+  unlink(path.c_str());
+}
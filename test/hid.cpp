@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+
+#include "common.hpp"
+#include "hid.h"
+
+using Joypad = sen::HID::Joypad;
+
+TEST(HIDTest, GroupsShareOneValueBlock) {
+  Joypad joypad;
+  joypad.GetButtons().Resize(4);
+  joypad.GetAxes().Resize(2);  //inserted ahead of the buttons
+  joypad.GetHats().Append("0");
+  ASSERT_EQ(joypad.GetAxes().size(), 2u);
+  ASSERT_EQ(joypad.GetButtons().size(), 4u);
+
+  joypad.GetButtons().GetInput(3).SetValue(1);
+  joypad.GetAxes().GetInput(1).SetValue(-200);
+  auto axes = joypad.GetAxes().GetValues();
+  EXPECT_EQ(axes[1], -200);
+  EXPECT_EQ(axes + 2, joypad.GetHats().GetValues());
+  EXPECT_EQ(joypad.GetHats().GetValues() + 1, joypad.GetButtons().GetValues());
+  EXPECT_EQ(joypad.GetButtons().GetValues()[3], 1);
+  EXPECT_TRUE(joypad.GetTriggers().empty());
+}
+
+TEST(HIDTest, InputNamesAreInterned) {
+  Joypad first, second;
+  first.GetButtons().Resize(12);
+  second.GetButtons().Resize(12);
+  EXPECT_EQ(first.GetButtons().GetInput(11).GetName(), "11");
+  EXPECT_EQ(&first.GetButtons().GetInput(11).GetName(), &second.GetButtons().GetInput(11).GetName());
+  EXPECT_EQ(&first.GetGroup(Joypad::GroupID::Hat).GetName(), &second.GetHats().GetName());
+  EXPECT_EQ(first.GetButtons().Find("7"), 7u);
+  EXPECT_EQ(first.GetButtons().Find("07"), uint(-1));
+  EXPECT_EQ(first.GetButtons().Find("12"), uint(-1));
+  EXPECT_EQ(first.Find("Button"), uint(Joypad::GroupID::Button));
+
+  auto &group = first.GetAxes();
+  group.Resize(1);
+  group.Append("Wheel");
+  group.Resize(3);
+  EXPECT_EQ(group.GetInput(0).GetName(), "0");
+  EXPECT_EQ(group.GetInput(1).GetName(), "Wheel");
+  EXPECT_EQ(group.GetInput(2).GetName(), "2");
+  EXPECT_EQ(group.Find("Wheel"), 1u);
+  EXPECT_EQ(group.Find("2"), 2u);
+}
@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include "common.hpp"
+#include "input.hpp"
+#include "hub.hpp"
+#include "hid.h"
+#include "pipe.hpp"
+
+// An Input attached to the hub named "pipe", whose shared driver is a PipeDriver.
+struct SharedInput : sen::Input {
+  explicit SharedInput(PipeDriver *&driver, uint &created) {
+    instance_ = std::make_unique<sen::InputShared>(*this, "pipe", [&](sen::Input &host) -> sen::unique_ptr<sen::InputDriver> {
+      created++;
+      auto pipe = std::make_unique<PipeDriver>(host, 2);
+      driver = pipe.get();
+      return pipe;
+    });
+    SetContext(1);
+  }
+};
+
+TEST(HubTest, ChangesAreFannedOutToEveryInput) {
+  PipeDriver *driver = nullptr;
+  uint created = 0;
+  SharedInput ui{driver, created}, game{driver, created};
+  EXPECT_TRUE(ui.Ready());
+  EXPECT_TRUE(game.Ready());
+  EXPECT_EQ(created, 1u);
+
+  sen::vector<sen::InputChange> uiChanges, gameChanges;
+  ui.OnChangeBatch([&](const sen::InputChange *changes, size_t count) { uiChanges.insert(uiChanges.end(), changes, changes + count); });
+  game.OnChangeBatch([&](const sen::InputChange *changes, size_t count) { gameChanges.insert(gameChanges.end(), changes, changes + count); });
+
+  sen::vector<sen::shared_ptr<sen::HID::Device>> uiDevices, gameDevices;
+  driver->Inject(0, EV_KEY, BTN_SOUTH, 1);
+  ui.Poll(uiDevices);
+  driver->Inject(1, EV_KEY, BTN_SOUTH, 1);
+  ui.Poll(uiDevices);
+  game.Poll(gameDevices);  //the events were read once, by the first poll
+  EXPECT_EQ(uiDevices, gameDevices);
+  ASSERT_EQ(uiChanges.size(), 2u);
+  ASSERT_EQ(gameChanges.size(), 2u);
+  for (uint n = 0; n < 2; ++n) {
+    EXPECT_EQ(gameChanges[n].handle, uiChanges[n].handle);
+    EXPECT_EQ(gameChanges[n].timestamp, uiChanges[n].timestamp);
+    EXPECT_EQ(gameChanges[n].new_value, 1);
+  }
+  EXPECT_EQ(gameChanges[0].handle, gameDevices[0]->GetHandle());
+  EXPECT_EQ(gameChanges[1].handle, gameDevices[1]->GetHandle());
+
+  //a detached Input no longer queues changes
+  game.Reset();
+  driver->Inject(0, EV_KEY, BTN_SOUTH, 0);
+  ui.Poll(uiDevices);
+  EXPECT_EQ(uiChanges.size(), 3u);
+}
+
+TEST(HubTest, HubIsReleasedWithTheLastInput) {
+  PipeDriver *driver = nullptr;
+  uint created = 0;
+  {
+    SharedInput first{driver, created};
+    SharedInput second{driver, created};
+    first.Reset();
+    SharedInput third{driver, created};
+    EXPECT_EQ(created, 1u);
+  }
+  SharedInput fourth{driver, created};
+  EXPECT_EQ(created, 2u);
+}
+
+TEST(HubTest, RemovedDevicesOutliveQueuedChanges) {
+  PipeDriver *driver = nullptr;
+  uint created = 0;
+  SharedInput ui{driver, created}, game{driver, created};
+  sen::vector<sen::shared_ptr<sen::HID::Device>> uiDevices, gameDevices;
+  ui.Poll(uiDevices);
+  game.Poll(gameDevices);
+  auto removed = gameDevices[1]->GetHandle();
+  gameDevices.clear();
+
+  sen::vector<sen::Handle> handles;
+  game.OnChangeBatch([&](const sen::InputChange *changes, size_t count) {
+    for (size_t n = 0; n < count; ++n) handles.push_back(changes[n].device->GetHandle());
+  });
+  driver->Inject(1, EV_KEY, BTN_SOUTH, 1);
+  ui.Poll(uiDevices);
+  driver->Remove(1);
+  ui.Poll(uiDevices);
+  EXPECT_EQ(uiDevices.size(), 1u);
+
+  game.Poll(gameDevices);
+  EXPECT_EQ(gameDevices.size(), 1u);
+  ASSERT_EQ(handles.size(), 1u);
+  EXPECT_EQ(handles[0], removed);
+}
+
+TEST(HubTest, InputsPolledInTurnShareADriverPoll) {
+  PipeDriver *driver = nullptr;
+  uint created = 0;
+  SharedInput ui{driver, created}, game{driver, created};
+  sen::vector<sen::shared_ptr<sen::HID::Device>> uiDevices, gameDevices;
+  ui.Poll(uiDevices);
+  game.Poll(gameDevices);
+
+  uint uiChanges = 0, gameChanges = 0;
+  game.OnChangeBatch([&](const sen::InputChange *, size_t count) { gameChanges += count; });
+  //the changes are delivered outside the hub lock, so a callback may use the hub
+  ui.OnChangeBatch([&](const sen::InputChange *, size_t count) {
+    uiChanges += count;
+    EXPECT_FALSE(ui.Acquired());
+    game.Poll(gameDevices);
+  });
+
+  driver->Inject(0, EV_KEY, BTN_SOUTH, 1);
+  ui.Poll(uiDevices);
+  EXPECT_EQ(uiChanges, 1u);
+  EXPECT_EQ(gameChanges, 1u);
+
+  //game polled after ui, so its next poll reuses ui's driver poll
+  ui.OnChangeBatch([&](const sen::InputChange *, size_t count) { uiChanges += count; });
+  ui.Poll(uiDevices);
+  driver->Inject(1, EV_KEY, BTN_SOUTH, 1);
+  game.Poll(gameDevices);
+  EXPECT_EQ(gameChanges, 1u);
+  game.Poll(gameDevices);
+  EXPECT_EQ(gameChanges, 2u);
+  ui.Poll(uiDevices);
+  EXPECT_EQ(uiChanges, 2u);
+}
+
+TEST(HubTest, RumbleDoesNotWaitForAnotherInputsPoll) {
+  PipeDriver *driver = nullptr;
+  uint created = 0;
+  SharedInput ui{driver, created}, game{driver, created};
+  sen::vector<sen::shared_ptr<sen::HID::Device>> uiDevices, gameDevices;
+  ui.Poll(uiDevices);
+  game.Poll(gameDevices);
+
+  //ui's poll holds the hub until game has rumbled
+  std::atomic<bool> polling{false}, rumbled{false};
+  driver->polling = [&] {
+    polling = true;
+    while (!rumbled) std::this_thread::yield();
+  };
+  std::thread poller([&] { ui.Poll(uiDevices); });
+  while (!polling) std::this_thread::yield();
+  EXPECT_TRUE(game.Rumble(gameDevices[0]->GetHandle(), 65535, 0, 0));
+  EXPECT_EQ(game.Statistics(gameDevices[0]->GetHandle()).kernel.count, 0u);
+  rumbled = true;
+  poller.join();
+  driver->polling = nullptr;
+}
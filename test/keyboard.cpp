@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+
+#include "common.hpp"
+#include "input.hpp"
+#include "hid.h"
+#include "keyboard/udev.hpp"
+
+using Keyboard = sen::HID::Keyboard;
+
+// Two keyboards fed from pipes instead of evdev nodes.
+struct PipeKeyboards {
+  PipeKeyboards() {
+    keyboard.Initialize(nullptr);  //no udev: only the epoll set
+    for (uint n = 0; n < 2; ++n) {
+      int fds[2];
+      if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0) break;
+      keyboard.AppendKeyboard(fds[0], "pipe" + std::to_string(n));
+      writers.push_back(fds[1]);
+    }
+    input.OnChange([this](sen::shared_ptr<sen::HID::Device>, uint group, uint code, int16_t, int16_t value) {
+      EXPECT_EQ(group, Keyboard::GroupID::Button);
+      changes.emplace_back(code, value);
+    });
+  }
+  ~PipeKeyboards() {
+    for (auto fd : writers) close(fd);
+    keyboard.Terminate();
+  }
+
+  auto Inject(uint device, uint16_t type, uint16_t code, int32_t value) -> void {
+    input_event event{};
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    (void) !write(writers[device], &event, sizeof(event));
+  }
+
+  sen::Input input;
+  sen::InputKeyboardUdev keyboard{input};
+  sen::vector<int> writers;
+  sen::vector<std::pair<uint, int16_t>> changes;
+};
+
+TEST(KeyboardTest, KeyboardsAreMerged) {
+  PipeKeyboards test;
+  sen::vector<sen::shared_ptr<sen::HID::Device>> devices;
+  test.keyboard.Devices(devices);
+  ASSERT_EQ(devices.size(), 1u);
+  auto &buttons = devices[0]->GetGroup(Keyboard::GroupID::Button);
+  EXPECT_EQ(buttons.size(), uint(KEY_CNT));
+  EXPECT_EQ(buttons.Find("Escape"), uint(KEY_ESC));
+  EXPECT_EQ(buttons.Find("A"), uint(KEY_A));
+  EXPECT_EQ(buttons.GetInput(KEY_F12).GetName(), "F12");
+
+  test.Inject(0, EV_KEY, KEY_LEFTSHIFT, 1);
+  test.Inject(1, EV_KEY, KEY_LEFTSHIFT, 1);
+  test.Inject(1, EV_KEY, KEY_Z, 1);
+  test.Inject(1, EV_KEY, KEY_Z, 2);  //repeat
+  test.Inject(1, EV_KEY, KEY_COMPOSE, 1);
+  test.keyboard.Poll();
+  using Changes = sen::vector<std::pair<uint, int16_t>>;
+  EXPECT_EQ(test.changes, (Changes{{KEY_LEFTSHIFT, 1}, {KEY_Z, 1}, {KEY_COMPOSE, 1}}));
+  EXPECT_EQ(buttons.GetInput(KEY_Z).GetValue(), 1);
+
+  //held on the other keyboard
+  test.changes.clear();
+  test.Inject(0, EV_KEY, KEY_LEFTSHIFT, 0);
+  test.keyboard.Poll();
+  EXPECT_TRUE(test.changes.empty());
+
+  //a removed keyboard releases its keys
+  test.keyboard.Hotplug("remove", "pipe1");
+  EXPECT_EQ(test.changes, (Changes{{KEY_LEFTSHIFT, 0}, {KEY_Z, 0}, {KEY_COMPOSE, 0}}));
+  EXPECT_EQ(buttons.GetInput(KEY_COMPOSE).GetValue(), 0);
+}
+
+TEST(KeyboardTest, DroppedEventsAreDiscardedUntilReport) {
+  PipeKeyboards test;
+  test.Inject(0, EV_SYN, SYN_DROPPED, 0);
+  test.Inject(0, EV_KEY, KEY_A, 1);
+  test.Inject(0, EV_SYN, SYN_REPORT, 0);
+  test.Inject(0, EV_KEY, KEY_B, 1);
+  test.keyboard.Poll();
+  ASSERT_EQ(test.changes.size(), 1u);
+  EXPECT_EQ(test.changes[0].first, uint(KEY_B));
+  EXPECT_EQ(test.keyboard.drops, 1u);
+}
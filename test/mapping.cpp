@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+
+#include "common.hpp"
+#include "input.hpp"
+#include "mapping.hpp"
+#include "hid.h"
+#include "pipe.hpp"
+
+using Joypad = sen::HID::Joypad;
+
+TEST(MappingTest, AssignmentsRoundTrip) {
+  PipeInput input;
+  input.Install(2);
+  auto manager = std::make_shared<sen::InputManager>();
+  input.Poll(manager->devices);
+  auto &device = manager->devices[1];
+  device->SetID(0x1234);
+
+  sen::InputButton button{"A"};
+  manager->append(button);
+  button.SetAssignment(manager, device, Joypad::GroupID::Axis, 1, sen::InputMapping::Qualifier::Hi);
+  EXPECT_EQ(button.device, device);
+
+  sen::InputButton copy{"B"};
+  manager->append(copy);
+  copy.assignment = button.assignment;
+  copy.Bind();
+  EXPECT_EQ(copy.device, device);
+  EXPECT_EQ(copy.device_id, 0x1234u);
+  EXPECT_EQ(copy.group_id, uint(Joypad::GroupID::Axis));
+  EXPECT_EQ(copy.input_id, 1u);
+  EXPECT_EQ(copy.qualifier, sen::InputMapping::Qualifier::Hi);
+
+  device->SetID(0x5678);  //no longer the assigned device
+  copy.Bind();
+  EXPECT_EQ(copy.device, nullptr);
+  EXPECT_EQ(copy.Text(), "(disconnected)");
+}
+
+TEST(MappingTest, ChangesAreRoutedToBoundMappings) {
+  PipeInput input;
+  auto &driver = input.Install(2);
+  auto manager = std::make_shared<sen::InputManager>();
+  manager->create(input);
+  input.Poll(manager->devices);
+
+  sen::InputButton jump{"Jump"}, fire{"Fire"}, right{"Right"}, other{"Other"};
+  for (auto mapping : {&jump, &fire, &right, &other}) manager->append(*mapping);
+  jump.SetAssignment(manager, manager->devices[0], Joypad::GroupID::Button, 0);
+  fire.SetAssignment(manager, manager->devices[0], Joypad::GroupID::Button, 0);
+  right.SetAssignment(manager, manager->devices[0], Joypad::GroupID::Axis, 0, sen::InputMapping::Qualifier::Hi);
+  other.SetAssignment(manager, manager->devices[1], Joypad::GroupID::Button, 0);
+
+  auto routes = manager->routes(manager->devices[0]->GetHandle(), Joypad::GroupID::Button, 0);
+  EXPECT_EQ(routes.size(), 2u);
+  EXPECT_EQ(manager->routes(manager->devices[0]->GetHandle(), Joypad::GroupID::Hat, 0).size(), 0u);
+  EXPECT_EQ(manager->routes({}, Joypad::GroupID::Button, 0).size(), 0u);
+
+  sen::vector<std::pair<sen::string, int16_t>> events;
+  manager->onMapping([&](sen::InputMapping &mapping, int16_t, int16_t value) { events.emplace_back(mapping.name, value); });
+  size_t batched = 0;  //the manager leaves the batch listener to the application
+  input.OnChangeBatch([&](const sen::InputChange *, size_t count) { batched += count; });
+  driver.Inject(0, EV_KEY, BTN_SOUTH, 1);
+  driver.Inject(0, EV_ABS, ABS_X, 1000);   //below the Hi threshold
+  driver.Inject(0, EV_ABS, ABS_X, 30000);
+  input.Poll(manager->devices);
+  EXPECT_EQ(batched, 3u);
+  ASSERT_EQ(events.size(), 3u);
+  EXPECT_EQ(events[0], std::make_pair(sen::string("Jump"), int16_t(1)));
+  EXPECT_EQ(events[1], std::make_pair(sen::string("Fire"), int16_t(1)));
+  EXPECT_EQ(events[2], std::make_pair(sen::string("Right"), int16_t(1)));
+
+  //a removed device's handle no longer routes, even though another device remains
+  events.clear();
+  manager->remove(fire);
+  driver.Remove(1);
+  input.Poll(manager->devices);
+  manager->bind();
+  EXPECT_EQ(other.device, nullptr);
+  driver.Inject(0, EV_KEY, BTN_SOUTH, 0);
+  input.Poll(manager->devices);
+  ASSERT_EQ(events.size(), 1u);
+  EXPECT_EQ(events[0], std::make_pair(sen::string("Jump"), int16_t(0)));
+}
+
+struct Hotkeys {
+  Hotkeys() {
+    input.Install(1);
+    input.Poll(manager->devices);
+    device = manager->devices[0];
+  }
+
+  //key 0 is the button, keys 1 and 2 are the X and Y axes pushed high
+  auto Key(uint key) -> sen::string {
+    sen::InputMapping mapping{""};
+    if (key == 0) mapping.SetAssignment(nullptr, device, Joypad::GroupID::Button, 0);
+    else mapping.SetAssignment(nullptr, device, Joypad::GroupID::Axis, key - 1, sen::InputMapping::Qualifier::Hi);
+    return mapping.assignment;
+  }
+
+  auto Set(uint key, bool pressed) -> void {
+    if (key == 0) device->GetGroup(Joypad::GroupID::Button).GetInput(0).SetValue(pressed);
+    else device->GetGroup(Joypad::GroupID::Axis).GetInput(key - 1).SetValue(pressed ? +32767 : 0);
+    manager->pollHotkeys(now);
+  }
+
+  auto Add(const sen::string &name) -> sen::InputHotkey & {
+    auto &hotkey = manager->appendHotkey(name);
+    hotkey.OnPress([this, name] { events.push_back("+" + name); });
+    hotkey.OnRelease([this, name] { events.push_back("-" + name); });
+    return hotkey;
+  }
+
+  PipeInput input;
+  sen::shared_ptr<sen::InputManager> manager = std::make_shared<sen::InputManager>();
+  sen::shared_ptr<sen::HID::Device> device;
+  sen::vector<sen::string> events;
+  uint64_t now = 1000;  //milliseconds
+};
+
+TEST(MappingTest, ChordedHotkeysNeedEveryInput) {
+  Hotkeys test;
+  test.Add("Menu").assignment = test.Key(0);
+  test.Add("Reset").Chord(test.Key(1)).assignment = test.Key(0);
+  test.Add("Unbound").Chord("missing/0/Buttons/A").assignment = test.Key(0);
+  test.manager->bind();
+
+  test.Set(1, true);
+  EXPECT_TRUE(test.events.empty());
+  test.Set(0, true);
+  EXPECT_EQ(test.events, (sen::vector<sen::string>{"+Menu", "+Reset"}));
+  test.Set(1, false);
+  test.Set(1, false);  //unchanged
+  EXPECT_EQ(test.events, (sen::vector<sen::string>{"+Menu", "+Reset", "-Reset"}));
+  test.Set(0, false);
+  EXPECT_EQ(test.events.back(), "-Menu");
+
+  //a removed hotkey no longer fires, without a bind()
+  ASSERT_TRUE(test.manager->removeHotkey(*test.manager->findHotkey("Menu")));
+  EXPECT_EQ(test.manager->findHotkey("Menu"), nullptr);
+  test.events.clear();
+  test.Set(1, true);
+  test.Set(0, true);
+  EXPECT_EQ(test.events, (sen::vector<sen::string>{"+Reset"}));
+}
+
+TEST(MappingTest, SequencedHotkeysFollowTheOrder) {
+  Hotkeys test;
+  test.Add("Debug").Sequence(test.Key(0)).Sequence(test.Key(0)).Sequence(test.Key(1)).Timeout(50).assignment = test.Key(2);
+  test.manager->bind();
+
+  auto tap = [&](uint key) { test.Set(key, true), test.Set(key, false); };
+  tap(0), tap(1), tap(2);  //out of order
+  EXPECT_TRUE(test.events.empty());
+  tap(0), tap(0), tap(0), tap(1), tap(2);  //a wrong input restarts the sequence
+  EXPECT_TRUE(test.events.empty());
+  tap(0), tap(0), tap(1);
+  test.Set(2, true);
+  EXPECT_EQ(test.events, (sen::vector<sen::string>{"+Debug"}));
+  test.Set(2, false);
+  EXPECT_EQ(test.events.back(), "-Debug");
+
+  //each step must follow the previous one within the timeout
+  tap(0), tap(0), tap(1);
+  test.now += 50;
+  tap(2);
+  EXPECT_EQ(test.events.size(), 4u);
+  tap(0);
+  test.now += 51;
+  tap(0), tap(1), tap(2);
+  EXPECT_EQ(test.events.size(), 4u);
+  tap(0), tap(0), tap(1);
+  test.now += 51;
+  tap(2);
+  EXPECT_EQ(test.events.size(), 4u);
+}
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include "common.hpp"
+#include "input.hpp"
+#include "hid.h"
+#include "mouse/udev.hpp"
+
+using Mouse = sen::HID::Mouse;
+
+// Two mice fed from pipes instead of evdev nodes.
+struct PipeMice {
+  PipeMice() {
+    mouse.Initialize(nullptr);
+    for (uint n = 0; n < 2; ++n) {
+      int fds[2];
+      if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0) break;
+      mouse.AppendMouse(fds[0], "pipe" + std::to_string(n));
+      writers.push_back(fds[1]);
+    }
+    input.OnChange([this](sen::shared_ptr<sen::HID::Device>, uint group, uint id, int16_t, int16_t value) {
+      changes.push_back({group, id, value});
+    });
+  }
+  ~PipeMice() {
+    for (auto fd : writers) close(fd);
+    mouse.Terminate();
+  }
+
+  auto Inject(uint device, uint16_t type, uint16_t code, int32_t value, uint64_t timestamp = 0) -> void {
+    input_event event{};
+    event.input_event_sec = timestamp / 1'000'000'000;
+    event.input_event_usec = timestamp % 1'000'000'000 / 1'000;
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    (void) !write(writers[device], &event, sizeof(event));
+  }
+
+  auto Move(uint device, int32_t x, int32_t y, uint64_t timestamp = 0) -> void {
+    Inject(device, EV_REL, REL_X, x, timestamp);
+    Inject(device, EV_REL, REL_Y, y, timestamp);
+    Inject(device, EV_SYN, SYN_REPORT, 0, timestamp);
+  }
+
+  struct Change {
+    uint group;
+    uint id;
+    int16_t value;
+    auto operator==(const Change &source) const -> bool { return group == source.group && id == source.id && value == source.value; }
+  };
+
+  sen::Input input;
+  sen::InputMouseUdev mouse{input};
+  sen::vector<int> writers;
+  sen::vector<Change> changes;
+};
+
+TEST(MouseTest, MotionIsSummedPerPoll) {
+  PipeMice test;
+  using Changes = sen::vector<PipeMice::Change>;
+  for (uint n = 0; n < 32; ++n) test.Move(n & 1, 3, -2);
+  test.Inject(0, EV_REL, REL_WHEEL, 1);
+  test.Inject(0, EV_REL, REL_X, 100);  //no SYN_REPORT yet
+  test.mouse.Poll();
+  EXPECT_EQ(test.changes, (Changes{{Mouse::GroupID::Axis, 0, 96}, {Mouse::GroupID::Axis, 1, -64}}));
+
+  test.changes.clear();
+  test.Inject(0, EV_SYN, SYN_REPORT, 0);
+  test.mouse.Poll();
+  EXPECT_EQ(test.changes, (Changes{{Mouse::GroupID::Axis, 0, 100}, {Mouse::GroupID::Axis, 1, 0}, {Mouse::GroupID::Axis, 2, 1}}));
+
+  //an idle poll returns the axes to rest
+  test.changes.clear();
+  test.mouse.Poll();
+  test.mouse.Poll();
+  EXPECT_EQ(test.changes, (Changes{{Mouse::GroupID::Axis, 0, 0}, {Mouse::GroupID::Axis, 2, 0}}));
+}
+
+TEST(MouseTest, ButtonsAreMerged) {
+  PipeMice test;
+  using Changes = sen::vector<PipeMice::Change>;
+  test.Inject(1, EV_KEY, BTN_LEFT, 1);
+  test.Inject(1, EV_KEY, BTN_SIDE, 1);
+  test.mouse.Poll();
+  EXPECT_EQ(test.changes, (Changes{{Mouse::GroupID::Button, 0, 1}, {Mouse::GroupID::Button, 3, 1}}));
+  EXPECT_EQ(test.mouse.hid->GetButtons().GetInput(3).GetName(), "Side");
+
+  //held on the other mouse
+  test.Inject(0, EV_KEY, BTN_LEFT, 1);
+  test.Inject(0, EV_KEY, BTN_LEFT, 0);
+  test.mouse.Poll();
+  EXPECT_EQ(test.changes.size(), 2u);
+
+  test.changes.clear();
+  test.mouse.RemoveMouse("pipe1");
+  EXPECT_EQ(test.changes, (Changes{{Mouse::GroupID::Button, 0, 0}, {Mouse::GroupID::Button, 3, 0}}));
+}
+
+TEST(MouseTest, MotionHistoryKeepsTheLastReports) {
+  PipeMice test;
+  ASSERT_TRUE(test.mouse.SetMotionHistory(4));
+  for (uint n = 1; n <= 6; ++n) test.Move(0, n, -int(n), n * 125'000);  //8 kHz
+  test.mouse.Poll();
+  sen::vector<sen::InputMotion> samples;
+  test.mouse.Motion(samples);
+  ASSERT_EQ(samples.size(), 4u);
+  EXPECT_EQ(samples[0].x, 3);
+  EXPECT_EQ(samples[0].y, -3);
+  EXPECT_EQ(samples[0].timestamp, 375'000u);
+  EXPECT_EQ(samples[3].x, 6);
+
+  test.mouse.Poll();
+  test.mouse.Motion(samples);
+  EXPECT_TRUE(samples.empty());
+}
@@ -0,0 +1,104 @@
+#ifndef TEST_PIPE_HPP_
+#define TEST_PIPE_HPP_
+
+#include "common.hpp"
+#include "input.hpp"
+#include "joypad/udev.hpp"
+
+// Drives the real joypad decoder from pipes instead of evdev nodes. Every joypad
+// has two axes and buttons buttons, BTN_SOUTH then BTN_TRIGGER_HAPPY1 onwards.
+struct PipeDriver : sen::InputDriver {
+  explicit PipeDriver(sen::Input &super, uint count, uint buttons = 1) : InputDriver(super), joypad(super) {
+    joypad.Initialize();
+    for (uint n = 0; n < count; ++n) {
+      int fds[2];
+      if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0) break;
+      sen::InputJoypadUdev::Joypad jp;
+      jp.fd = fds[0];
+      jp.deviceNode = "pipe" + std::to_string(n);
+      jp.deviceName = jp.deviceNode;
+      jp.vendorID = "0000";
+      jp.productID = "0000";
+      jp.axes.emplace_back(ABS_X, 0);
+      jp.axes.back().info.minimum = -32768;
+      jp.axes.back().info.maximum = +32767;
+      jp.axes.emplace_back(ABS_Y, 1);
+      jp.axes.back().info.minimum = -32768;
+      jp.axes.back().info.maximum = +32767;
+      jp.buttons.emplace_back(BTN_SOUTH, 0);
+      for (uint id = 1; id < buttons; ++id) jp.buttons.emplace_back(BTN_TRIGGER_HAPPY1 + id - 1, id);
+      writers.push_back(fds[1]);
+      joypad.AppendJoypad(jp);
+    }
+  }
+  ~PipeDriver() override {
+    for (auto fd : writers) close(fd);
+    joypad.Terminate();
+  }
+
+  auto Driver() -> sen::string override { return "Pipe"; }
+
+  auto Poll(sen::vector<sen::shared_ptr<sen::HID::Device>> &devices) -> void override {
+    if (polling) polling();
+    joypad.Poll();
+    //a removal read in the same poll as the device's last events
+    for (auto device : unplug) Remove(device);
+    unplug.clear();
+    Publish(devices, joypad.generation, [&](auto &found) { joypad.Devices(found); });
+  }
+
+  auto HasThreaded() -> bool override { return true; }
+  auto SetThreaded(bool threaded) -> bool override { return joypad.SetThreaded(threaded); }
+  auto HasCoalesced() -> bool override { return true; }
+  auto SetCoalesced(bool coalesced) -> bool override { return joypad.SetCoalesced(coalesced); }
+  auto Rumble(uint64_t id, uint16_t strong, uint16_t weak, uint16_t duration) -> bool override {
+    return joypad.Rumble(id, strong, weak, duration);
+  }
+  auto Rumble(sen::Handle handle, uint16_t strong, uint16_t weak, uint16_t duration) -> bool override {
+    return joypad.Rumble(handle, strong, weak, duration);
+  }
+  auto Statistics(uint64_t id) -> sen::InputStatistics override { return joypad.Statistics(id); }
+  auto Statistics(sen::Handle handle) -> sen::InputStatistics override { return joypad.Statistics(handle); }
+  auto Resync() -> void override { joypad.Resync(); }
+  auto Record(const sen::string &path) -> bool override { return joypad.Record(path); }
+
+  //simulates unplugging a device; the lock keeps the input thread out in threaded mode
+  auto Remove(uint device) -> void {
+    std::lock_guard<std::mutex> guard(joypad.lock);
+    joypad.RemoveJoypad(nullptr, "pipe" + std::to_string(device));
+  }
+
+  //bytes written to a device that the decoder has not read yet
+  auto Unread(uint device) -> int {
+    int bytes = 0;
+    std::lock_guard<std::mutex> guard(joypad.lock);
+    if (auto jp = joypad.FindNode("pipe" + std::to_string(device))) ioctl(jp->fd, FIONREAD, &bytes);
+    return bytes;
+  }
+
+  auto Inject(uint device, uint16_t type, uint16_t code, int32_t value, uint64_t timestamp = 0) -> void {
+    input_event event{};
+    event.input_event_sec = timestamp / 1'000'000'000;
+    event.input_event_usec = timestamp % 1'000'000'000 / 1'000;
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    (void) !write(writers[device], &event, sizeof(event));
+  }
+
+  sen::InputJoypadUdev joypad;
+  sen::vector<int> writers;
+  sen::vector<uint> unplug;
+  std::function<void()> polling;  //called at the start of every Poll()
+};
+
+struct PipeInput : sen::Input {
+  auto Install(uint count, uint buttons = 1) -> PipeDriver & {
+    auto driver = std::make_unique<PipeDriver>(*this, count, buttons);
+    auto &result = *driver;
+    instance_ = std::move(driver);
+    return result;
+  }
+};
+
+#endif //TEST_PIPE_HPP_
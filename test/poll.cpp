@@ -0,0 +1,445 @@
+#include <gtest/gtest.h>
+
+#include <new>
+#include <cstdlib>
+#include "common.hpp"
+#include "input.hpp"
+#include "joypad/udev.hpp"
+#include "pipe.hpp"
+#include "hid.h"
+
+// Counts every heap allocation made by the process, including those made
+// inside the input library.
+static std::atomic<uint64_t> allocations{0};
+
+//the replacements pair malloc() with free(), which gcc cannot see through once
+//they are inlined into the test bodies
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void *operator new(size_t size) {
+  allocations++;
+  if (void *data = malloc(size ? size : 1)) return data;
+  throw std::bad_alloc();
+}
+void operator delete(void *data) noexcept { free(data); }
+void operator delete(void *data, size_t) noexcept { free(data); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+TEST(PollTest, SteadyStateDoesNotAllocate) {
+  PipeInput input;
+  auto &driver = input.Install(4);
+  uint64_t changes = 0;
+  input.OnChangeBatch([&](const sen::InputChange *, size_t count) { changes += count; });
+
+  sen::vector<sen::shared_ptr<sen::HID::Device>> devices;
+  auto frame = [&](uint n) {
+    driver.Inject(n % 4, EV_ABS, ABS_X, int(n * 997 % 65536) - 32768);
+    driver.Inject(n % 4, EV_KEY, BTN_SOUTH, n & 1);
+    input.Poll(devices);
+  };
+
+  for (uint n = 0; n < 16; ++n) frame(n);  //warm up reusable buffers
+  ASSERT_EQ(devices.size(), 4u);
+  auto before = changes;
+
+  auto baseline = allocations.load();
+  for (uint n = 16; n < 1024; ++n) frame(n);
+  EXPECT_EQ(allocations.load() - baseline, 0u);
+  EXPECT_GT(changes, before);
+  EXPECT_EQ(devices.size(), 4u);
+}
+
+TEST(PollTest, DeviceCreationAllocationsAreBounded) {
+  sen::HID::Joypad warm;
+  warm.GetButtons().Resize(64);  //interns the group names, keeping first use costs out of the count
+
+  auto baseline = allocations.load();
+  auto joypad = std::make_shared<sen::HID::Joypad>();
+  joypad->GetAxes().Resize(8);
+  joypad->GetHats().Resize(8);
+  joypad->GetButtons().Resize(64);
+  EXPECT_LE(allocations.load() - baseline, 6u);
+}
+
+TEST(PollTest, DeviceSetIsStableAcrossPolls) {
+  PipeInput input;
+  input.Install(2);
+
+  sen::vector<sen::shared_ptr<sen::HID::Device>> first, second;
+  input.Poll(first);
+  input.Poll(second);
+  ASSERT_EQ(first.size(), 2u);
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(input.Poll(), first);
+}
+
+TEST(PollTest, ChangesCarryEventTimestamps) {
+  PipeInput input;
+  auto &driver = input.Install(1);
+  sen::vector<sen::InputChange> changes;
+  input.OnChangeBatch([&](const sen::InputChange *data, size_t count) { changes.assign(data, data + count); });
+
+  driver.Inject(0, EV_ABS, ABS_X, 1000, 12'345'678'000);
+  driver.Inject(0, EV_KEY, BTN_SOUTH, 1, 12'345'679'000);
+  input.Poll();
+  ASSERT_EQ(changes.size(), 2u);
+  EXPECT_EQ(changes[0].timestamp, 12'345'678'000u);
+  EXPECT_EQ(changes[1].timestamp, 12'345'679'000u);
+  EXPECT_EQ(changes[1].group, sen::HID::Joypad::GroupID::Button);
+  EXPECT_EQ(changes[1].new_value, 1);
+}
+
+TEST(PollTest, ReadTimeReplacesForeignEventTimes) {
+  PipeInput input;
+  auto &driver = input.Install(1);
+  driver.joypad.FindNode("pipe0")->eventTime = false;  //as if EVIOCSCLOCKID had failed
+  sen::vector<sen::InputChange> changes;
+  input.OnChangeBatch([&](const sen::InputChange *data, size_t count) { changes.assign(data, data + count); });
+
+  driver.Inject(0, EV_KEY, BTN_SOUTH, 1, 12'345'678'000);
+  auto before = driver.joypad.Now();
+  input.Poll();
+  ASSERT_EQ(changes.size(), 1u);
+  EXPECT_GE(changes[0].timestamp, before);
+  EXPECT_LE(changes[0].timestamp, driver.joypad.Now());
+}
+
+TEST(PollTest, LatencyIsRecordedPerDevice) {
+  PipeInput input;
+  auto &driver = input.Install(2);
+  sen::vector<sen::shared_ptr<sen::HID::Device>> devices;
+  input.Poll(devices);
+  devices[0]->SetID(1);
+  devices[1]->SetID(2);
+
+  for (uint n = 0; n < 100; ++n) {
+    auto now = driver.joypad.Now();
+    driver.Inject(0, EV_ABS, ABS_X, n & 1 ? 1000 : -1000, now - 1'000'000);  //1ms in the past
+    input.Poll(devices);
+  }
+
+  auto statistics = input.Statistics(1);
+  EXPECT_EQ(statistics.kernel.count, 100u);
+  EXPECT_GE(statistics.kernel.p50, 1'000'000u);
+  EXPECT_LE(statistics.kernel.p50, statistics.kernel.p99);
+  EXPECT_LE(statistics.kernel.p99, statistics.kernel.maximum);
+  EXPECT_EQ(statistics.read.count, 100u);
+  EXPECT_EQ(input.Statistics(2).kernel.count, 0u);
+}
+
+TEST(PollTest, NormalizationMatchesDivision) {
+  for (auto [minimum, maximum] : {std::pair{-32768, 32767}, {0, 255}, {-1, 1}, {0, 1023}, {-512, 511}, {0, 0}}) {
+    sen::InputJoypadUdev::JoypadCode entry;
+    entry.SetRange(minimum, maximum);
+    sen::vector<uint32_t> offsets, highs, lows;
+    sen::vector<int64_t> expected;
+    for (int64_t value = minimum - 4; value <= maximum + 4; ++value) {
+      int64_t clamped = std::clamp<int64_t>(value - minimum, 0, entry.range);
+      ASSERT_EQ(entry.Normalize(int32_t(value)), sen::sclamp<16>(clamped * 65535 / entry.range - 32767));
+      offsets.push_back(entry.Offset(int32_t(value)));
+      highs.push_back(entry.scaleHigh);
+      lows.push_back(entry.scaleLow);
+      expected.push_back(sen::sclamp<16>(clamped * 65535 / entry.range - 32767));
+    }
+    sen::vector<int16_t> values(offsets.size());
+    sen::InputJoypadUdev::Normalize(offsets.data(), highs.data(), lows.data(), values.data(), offsets.size());
+    for (size_t n = 0; n < values.size(); ++n) {
+      ASSERT_EQ(values[n], expected[n]) << "range " << minimum << ".." << maximum << " offset " << offsets[n];
+    }
+  }
+}
+
+TEST(PollTest, CoalescedReportsCommitFinalValues) {
+  PipeInput input;
+  auto &driver = input.Install(1);
+  ASSERT_TRUE(input.SetCoalesced(true));
+  sen::vector<sen::InputChange> changes;
+  input.OnChangeBatch([&](const sen::InputChange *data, size_t count) { changes.assign(data, data + count); });
+
+  //a diagonal move with an intermediate X value, split by a poll before SYN_REPORT
+  driver.Inject(0, EV_ABS, ABS_X, 1000);
+  driver.Inject(0, EV_ABS, ABS_X, 2000);
+  input.Poll();
+  EXPECT_TRUE(changes.empty());
+  driver.Inject(0, EV_ABS, ABS_Y, -2000);
+  driver.Inject(0, EV_SYN, SYN_REPORT, 0);
+  input.Poll();
+  ASSERT_EQ(changes.size(), 2u);
+  EXPECT_EQ(changes[0].input, 0u);
+  EXPECT_EQ(changes[0].new_value, 2001);  //2000 normalized over -32768..32767
+  EXPECT_EQ(changes[1].input, 1u);
+  EXPECT_EQ(changes[1].new_value, -1999);
+
+  //a press and release within one report is not a change
+  changes.clear();
+  driver.Inject(0, EV_KEY, BTN_SOUTH, 1);
+  driver.Inject(0, EV_KEY, BTN_SOUTH, 0);
+  driver.Inject(0, EV_SYN, SYN_REPORT, 0);
+  input.Poll();
+  EXPECT_TRUE(changes.empty());
+
+  //staged values are committed when coalescing is turned off
+  driver.Inject(0, EV_KEY, BTN_SOUTH, 1);
+  input.Poll();
+  ASSERT_TRUE(input.SetCoalesced(false));
+  input.Poll();
+  ASSERT_EQ(changes.size(), 1u);
+  EXPECT_EQ(changes[0].group, sen::HID::Joypad::GroupID::Button);
+}
+
+TEST(PollTest, DroppedEventsAreDiscardedUntilReport) {
+  PipeInput input;
+  auto &driver = input.Install(1);
+  sen::vector<sen::shared_ptr<sen::HID::Device>> devices;
+  input.Poll(devices);
+  devices[0]->SetID(1);
+  sen::vector<sen::InputChange> changes;
+  input.OnChangeBatch([&](const sen::InputChange *data, size_t count) { changes.assign(data, data + count); });
+
+  driver.Inject(0, EV_SYN, SYN_DROPPED, 0);
+  driver.Inject(0, EV_KEY, BTN_SOUTH, 1);
+  input.Poll(devices);
+  driver.Inject(0, EV_ABS, ABS_X, 1000);
+  driver.Inject(0, EV_SYN, SYN_REPORT, 0);
+  driver.Inject(0, EV_KEY, BTN_SOUTH, 1);
+  input.Poll(devices);
+  ASSERT_EQ(changes.size(), 1u);
+  EXPECT_EQ(changes[0].group, sen::HID::Joypad::GroupID::Button);
+  EXPECT_EQ(input.Statistics(1).drops, 1u);
+}
+
+TEST(PollTest, ResyncOnlyReportsInputsThatDiffer) {
+  PipeInput input;
+  auto &driver = input.Install(1);
+  sen::vector<sen::shared_ptr<sen::HID::Device>> devices;
+  input.Poll(devices);
+  sen::vector<sen::InputChange> changes;
+  input.OnChangeBatch([&](const sen::InputChange *data, size_t count) { changes.assign(data, data + count); });
+
+  //the kernel state: BTN_SOUTH held and ABS_X at its maximum, ABS_Y where the HID state has it
+  driver.joypad.queryKeys = [](int, uint8_t *keys, size_t) {
+    keys[BTN_SOUTH >> 3] |= 1 << (BTN_SOUTH & 7);
+    return true;
+  };
+  driver.joypad.queryAbsolute = [](int, uint code, input_absinfo &info) {
+    if (code == ABS_X) info.value = +32767;
+    return code == ABS_X;
+  };
+  auto resync = [&] {
+    changes.clear();
+    driver.Inject(0, EV_SYN, SYN_DROPPED, 0);
+    driver.Inject(0, EV_SYN, SYN_REPORT, 0);
+    input.Poll(devices);
+  };
+
+  resync();
+  ASSERT_EQ(changes.size(), 2u);
+  EXPECT_EQ(changes[0].group, sen::HID::Joypad::GroupID::Button);
+  EXPECT_EQ(changes[0].new_value, 1);
+  EXPECT_EQ(changes[1].group, sen::HID::Joypad::GroupID::Axis);
+  EXPECT_EQ(changes[1].input, 0u);
+  EXPECT_EQ(changes[1].new_value, 32767);
+
+  //nothing changed since
+  resync();
+  EXPECT_TRUE(changes.empty());
+}
+
+TEST(PollTest, ResyncReadsEveryJoypadBack) {
+  PipeInput input;
+  auto &driver = input.Install(2);
+  sen::vector<sen::shared_ptr<sen::HID::Device>> devices;
+  input.Poll(devices);
+  sen::vector<sen::InputChange> changes;
+  input.OnChangeBatch([&](const sen::InputChange *data, size_t count) { changes.insert(changes.end(), data, data + count); });
+  driver.joypad.queryKeys = [](int, uint8_t *keys, size_t) {
+    keys[BTN_SOUTH >> 3] |= 1 << (BTN_SOUTH & 7);
+    return true;
+  };
+  driver.joypad.queryAbsolute = [](int, uint, input_absinfo &) { return false; };
+
+  input.Resync();
+  input.Poll(devices);
+  ASSERT_EQ(changes.size(), 2u);
+  for (auto &change : changes) {
+    EXPECT_EQ(change.group, sen::HID::Joypad::GroupID::Button);
+    EXPECT_EQ(change.new_value, 1);
+  }
+  EXPECT_NE(changes[0].handle, changes[1].handle);
+
+  //threaded, the changes are queued behind the input thread's
+  changes.clear();
+  driver.joypad.queryKeys = [](int, uint8_t *, size_t) { return true; };
+  ASSERT_TRUE(input.SetThreaded(true));
+  input.Resync();
+  input.Poll(devices);
+  EXPECT_EQ(changes.size(), 2u);
+  ASSERT_TRUE(input.SetThreaded(false));
+}
+
+TEST(PollTest, ThreadedModeDeliversInOrder) {
+  PipeInput input;
+  auto &driver = input.Install(3);
+  sen::vector<sen::shared_ptr<sen::HID::Device>> devices;
+  input.Poll(devices);
+  ASSERT_TRUE(input.SetThreaded(true));
+  sen::vector<sen::InputChange> changes;
+  sen::vector<sen::Handle> handles;
+  input.OnChangeBatch([&](const sen::InputChange *data, size_t count) {
+    for (size_t n = 0; n < count; ++n) handles.push_back(data[n].device->GetHandle());
+    changes.insert(changes.end(), data, data + count);
+  });
+  auto until = [&](size_t count) {
+    for (uint n = 0; n < 2000 && changes.size() < count; ++n) {
+      input.Poll(devices);
+      if (changes.size() < count) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return changes.size() == count;
+  };
+
+  //more changes than the ring holds: the thread waits for Poll() to drain it
+  const uint events = 2000;
+  for (uint n = 0; n < events; ++n) {
+    for (uint device = 0; device < 3; ++device) driver.Inject(device, EV_ABS, ABS_X, n & 1 ? 1000 : -1000);
+  }
+  ASSERT_TRUE(until(3 * events));
+  sen::vector<int16_t> last(3, 0);
+  for (auto &change : changes) {
+    uint device = std::find(devices.begin(), devices.end(), change.device->shared_from_this()) - devices.begin();
+    ASSERT_LT(device, 3u);
+    EXPECT_NE(change.new_value, last[device]);  //alternating values, each one a change
+    last[device] = change.new_value;
+  }
+
+  //a device removed after its events were read still delivers them
+  changes.clear();
+  handles.clear();
+  auto removed = devices[2]->GetHandle();
+  driver.Inject(2, EV_KEY, BTN_SOUTH, 1);
+  for (uint n = 0; n < 2000 && driver.Unread(2); ++n) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  driver.Remove(2);
+  driver.Inject(0, EV_KEY, BTN_SOUTH, 1);
+  ASSERT_TRUE(until(2));
+  EXPECT_EQ(handles[0], removed);
+  EXPECT_EQ(handles[1], devices[0]->GetHandle());
+  EXPECT_EQ(devices.size(), 2u);
+  ASSERT_TRUE(input.SetThreaded(false));
+}
+
+TEST(PollTest, ThreadedResyncWaitsForRoomInTheRing) {
+  constexpr uint buttons = 40;
+  PipeInput input;
+  auto &driver = input.Install(1, buttons);
+  sen::vector<sen::shared_ptr<sen::HID::Device>> devices;
+  input.Poll(devices);
+  ASSERT_TRUE(input.SetThreaded(true));
+  size_t delivered = 0;
+  input.OnChangeBatch([&](const sen::InputChange *, size_t count) { delivered += count; });
+
+  //leave fewer free slots than the resync below emits, but more than one read needs
+  const uint queued = 4096 - buttons + 8;
+  for (uint n = 0; n < queued;) {
+    for (uint burst = 0; burst < 1024 && n < queued; ++burst, ++n) driver.Inject(0, EV_ABS, ABS_X, n & 1 ? 1000 : -1000);
+    for (uint wait = 0; wait < 2000 && driver.Unread(0) && !driver.joypad.stalled; ++wait) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  driver.joypad.queryKeys = [](int, uint8_t *keys, size_t) {
+    for (uint code = BTN_TRIGGER_HAPPY1; code < BTN_TRIGGER_HAPPY1 + buttons - 1; ++code) keys[code >> 3] |= 1 << (code & 7);
+    keys[BTN_SOUTH >> 3] |= 1 << (BTN_SOUTH & 7);
+    return true;
+  };
+  driver.joypad.queryAbsolute = [](int, uint, input_absinfo &) { return false; };
+  driver.Inject(0, EV_SYN, SYN_DROPPED, 0);
+  driver.Inject(0, EV_SYN, SYN_REPORT, 0);
+  for (uint n = 0; n < 2000 && delivered < queued + buttons; ++n) {
+    input.Poll(devices);
+    if (delivered < queued + buttons) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_TRUE(input.SetThreaded(false));
+  EXPECT_EQ(delivered, size_t(queued + buttons));
+  auto &group = devices[0]->GetGroup(sen::HID::Joypad::GroupID::Button);
+  for (uint id = 0; id < buttons; ++id) EXPECT_EQ(group.GetInput(id).GetValue(), 1) << id;
+}
+
+TEST(PollTest, DeviceRemovedInTheSamePollOutlivesItsChanges) {
+  PipeInput input;
+  auto &driver = input.Install(2);
+  sen::vector<sen::shared_ptr<sen::HID::Device>> devices;
+  input.Poll(devices);
+  std::weak_ptr<sen::HID::Device> removed = devices[1];
+  auto handle = devices[1]->GetHandle();
+  devices.clear();
+
+  uint batched = 0, subscribed = 0;
+  input.OnChangeBatch([&](const sen::InputChange *changes, size_t count) {
+    ASSERT_EQ(count, 1u);
+    EXPECT_FALSE(removed.expired());
+    EXPECT_EQ(changes[0].device->GetHandle(), handle);
+    batched++;
+  });
+  input.Subscribe({}, [&](const sen::InputChange &change) {
+    EXPECT_EQ(change.device->GetHandle(), handle);
+    subscribed++;
+  });
+  driver.Inject(1, EV_KEY, BTN_SOUTH, 1);
+  driver.unplug.push_back(1);
+  input.Poll(devices);
+  EXPECT_EQ(batched, 1u);
+  EXPECT_EQ(subscribed, 1u);
+  EXPECT_EQ(devices.size(), 1u);
+  EXPECT_TRUE(removed.expired());
+}
+
+// A driver whose device list is published from a hand-set generation.
+struct ListDriver : sen::InputDriver {
+  using InputDriver::InputDriver;
+  auto Poll(sen::vector<sen::shared_ptr<sen::HID::Device>> &devices) -> void override {
+    Publish(devices, generation, [&](auto &found) {
+      collected++;
+      found = list;
+    });
+  }
+  sen::vector<sen::shared_ptr<sen::HID::Device>> list;
+  uint generation = 0;
+  uint collected = 0;
+};
+
+struct ListInput : sen::Input {
+  ListInput() {
+    auto driver = std::make_unique<ListDriver>(*this);
+    list = driver.get();
+    instance_ = std::move(driver);
+  }
+  ListDriver *list;
+};
+
+TEST(PollTest, DeviceListIsOnlyRebuiltOnANewGeneration) {
+  ListInput input;
+  auto &driver = *input.list;
+  driver.list.push_back(std::make_shared<sen::HID::Joypad>());
+  sen::vector<sen::shared_ptr<sen::HID::Device>> devices;
+  input.Poll(devices);
+  input.Poll(devices);
+  EXPECT_EQ(driver.collected, 1u);
+  EXPECT_EQ(devices, driver.list);
+
+  //the caller's container is restored without a rebuild
+  devices.clear();
+  input.Poll(devices);
+  EXPECT_EQ(driver.collected, 1u);
+  EXPECT_EQ(devices, driver.list);
+
+  driver.list.push_back(std::make_shared<sen::HID::Joypad>());
+  input.Poll(devices);
+  EXPECT_EQ(devices.size(), 1u);
+  driver.generation++;
+  input.Poll(devices);
+  EXPECT_EQ(driver.collected, 2u);
+  EXPECT_EQ(devices, driver.list);
+}
@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+
+#include "common.hpp"
+#include "input.hpp"
+#include "hid.h"
+#include "pipe.hpp"
+
+TEST(RegistryTest, SlotMapHandlesAreGenerational) {
+  sen::SlotMap<int, 2> map;
+  auto a = map.Insert(1);
+  auto b = map.Insert(2);
+  auto c = map.Insert(3);
+  int *address = map.Find(c);
+  ASSERT_NE(address, nullptr);
+
+  EXPECT_TRUE(map.Erase(a));
+  EXPECT_FALSE(map.Erase(a));
+  EXPECT_EQ(map.Find(a), nullptr);
+  auto d = map.Insert(4);  //reuses a's slot
+  EXPECT_EQ(d.index, a.index);
+  EXPECT_NE(d, a);
+  EXPECT_EQ(map.Find(a), nullptr);
+  EXPECT_EQ(*map.Find(d), 4);
+  EXPECT_EQ(map.Find(c), address);  //elements never move
+
+  sen::vector<int> order;
+  for (auto value : map) order.push_back(value);
+  EXPECT_EQ(order, (sen::vector<int>{2, 3, 4}));
+  EXPECT_EQ(*map.Find(b), 2);
+
+  //indices below First are reserved
+  sen::SlotMap<int, 2, 3> offset;
+  auto e = offset.Insert(5);
+  EXPECT_EQ(e.index, 3u);
+  EXPECT_EQ(*offset.Find(e), 5);
+  EXPECT_EQ(offset.Find({0, e.generation}), nullptr);
+  EXPECT_TRUE(offset.Erase(e));
+  EXPECT_EQ(offset.Insert(6).index, 3u);
+}
+
+TEST(RegistryTest, DevicesAreAddressedByHandle) {
+  PipeInput input;
+  auto &driver = input.Install(3);
+  sen::vector<sen::shared_ptr<sen::HID::Device>> devices;
+  input.Poll(devices);
+  ASSERT_EQ(devices.size(), 3u);
+  auto first = devices[0]->GetHandle();
+  auto last = devices[2]->GetHandle();
+  ASSERT_TRUE(first);
+  EXPECT_NE(first, last);
+  EXPECT_GE(first.index, uint32_t(sen::Handle::ReservedIndices));  //never the keyboard's or mouse's
+  auto *address = driver.joypad.Find(last);
+  ASSERT_NE(address, nullptr);
+  EXPECT_EQ(driver.joypad.FindNode("pipe2"), address);
+
+  driver.Remove(0);
+  input.Poll(devices);
+  ASSERT_EQ(devices.size(), 2u);
+  EXPECT_EQ(driver.joypad.Find(first), nullptr);
+  EXPECT_EQ(driver.joypad.Find(last), address);  //survives the removal of another device
+
+  sen::vector<sen::InputChange> changes;
+  input.OnChangeBatch([&](const sen::InputChange *data, size_t count) { changes.assign(data, data + count); });
+  driver.Inject(2, EV_KEY, BTN_SOUTH, 1);
+  input.Poll(devices);
+  ASSERT_EQ(changes.size(), 1u);
+  EXPECT_EQ(changes[0].handle, last);
+  EXPECT_EQ(input.Statistics(last).kernel.count, 1u);
+  EXPECT_EQ(input.Statistics(first).kernel.count, 0u);
+
+  //IDs may be reassigned by the caller at any time
+  devices[1]->SetID(42);
+  EXPECT_EQ(driver.joypad.FindID(42), address);
+  devices[0]->SetID(43);
+  EXPECT_EQ(driver.joypad.FindID(43), driver.joypad.FindNode("pipe1"));
+  EXPECT_EQ(driver.joypad.FindID(42), address);
+  EXPECT_EQ(driver.joypad.FindID(7), nullptr);
+
+  //removing one of two joypads that share an ID leaves the other addressable
+  devices[0]->SetID(42);
+  ASSERT_NE(driver.joypad.FindID(42), nullptr);
+  driver.Remove(2);
+  input.Poll(devices);
+  EXPECT_EQ(driver.joypad.FindID(42), driver.joypad.FindNode("pipe1"));
+}
+
+TEST(RegistryTest, RumbleIsQueuedForTheHapticsThread) {
+  static std::atomic<uint> uploads;
+  static std::atomic<uint> strong;
+  uploads = 0;
+  strong = 0;
+  int fds[2];
+  ASSERT_EQ(pipe2(fds, O_NONBLOCK | O_CLOEXEC), 0);
+  {
+    PipeInput input;
+    auto &driver = input.Install(2);
+    sen::vector<sen::shared_ptr<sen::HID::Device>> devices;
+    input.Poll(devices);
+    devices[0]->SetID(77);
+    {
+      //pipe joypads cannot rumble: give the first one a slow device
+      std::lock_guard<std::mutex> guard(driver.joypad.lock);
+      auto haptics = std::make_shared<sen::InputJoypadUdev::JoypadHaptics>();
+      haptics->fd = fds[1];
+      haptics->upload = [](int, ff_effect &effect) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        if (effect.id < 0) effect.id = 0;
+        strong = effect.u.rumble.strong_magnitude;
+        uploads++;
+        return true;
+      };
+      driver.joypad.FindNode("pipe0")->haptics = haptics;
+    }
+
+    //far fewer commands than the queue holds, so none may be dropped; the joypad
+    //is named by handle and by ID in turn, and both coalesce together
+    const uint commands = 128;
+    for (uint n = 1; n <= commands; ++n) {
+      if (n & 1) EXPECT_TRUE(input.Rumble(devices[0]->GetHandle(), uint16_t(n * 256), 0));
+      else EXPECT_TRUE(input.Rumble(uint64_t(77), uint16_t(n * 256), 0));
+    }
+    EXPECT_TRUE(input.Rumble(devices[1]->GetHandle(), true));  //no haptics: ignored
+    for (uint n = 0; n < 2000 && strong != commands * 256; ++n) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(strong, commands * 256);
+    EXPECT_LT(uploads, commands / 2);
+  }
+  close(fds[0]);
+}
+
+TEST(RegistryTest, TimedRumbleIsReplayedAfterItEnds) {
+  using Haptics = sen::InputJoypadUdev::JoypadHaptics;
+  static uint uploads;
+  uploads = 0;
+  int fds[2];
+  ASSERT_EQ(pipe2(fds, O_NONBLOCK | O_CLOEXEC), 0);
+  {
+    Haptics haptics;
+    haptics.fd = fds[1];  //the EV_FF writes land in the pipe
+    haptics.upload = [](int, ff_effect &effect) {
+      if (effect.id < 0) effect.id = 3;
+      uploads++;
+      return true;
+    };
+    auto played = [&] {
+      sen::vector<int32_t> values;
+      input_event event;
+      while (read(fds[0], &event, sizeof(event)) == sizeof(event)) {
+        EXPECT_EQ(event.type, EV_FF);
+        EXPECT_EQ(event.code, 3);
+        values.push_back(event.value);
+      }
+      return values;
+    };
+    const uint64_t ms = 1'000'000;
+
+    EXPECT_TRUE(sen::InputJoypadUdev::Rumble(haptics, 100, 0, 50, 0));
+    EXPECT_EQ(played(), sen::vector<int32_t>{1});
+    //the timed effect has ended: an untimed one must be started again
+    EXPECT_TRUE(sen::InputJoypadUdev::Rumble(haptics, 100, 0, 0, 100 * ms));
+    EXPECT_EQ(played(), sen::vector<int32_t>{1});
+    //an untimed effect is updated in place
+    EXPECT_TRUE(sen::InputJoypadUdev::Rumble(haptics, 200, 0, 0, 110 * ms));
+    EXPECT_TRUE(played().empty());
+    EXPECT_TRUE(sen::InputJoypadUdev::Rumble(haptics, 0, 0, 0, 120 * ms));
+    EXPECT_EQ(played(), sen::vector<int32_t>{0});
+    EXPECT_TRUE(sen::InputJoypadUdev::Rumble(haptics, 0, 0, 0, 130 * ms));
+    EXPECT_TRUE(played().empty());
+
+    //a timed effect that is still running is stopped, one that ended is not
+    EXPECT_TRUE(sen::InputJoypadUdev::Rumble(haptics, 100, 0, 50, 200 * ms));
+    EXPECT_TRUE(sen::InputJoypadUdev::Rumble(haptics, 0, 0, 0, 210 * ms));
+    EXPECT_EQ(played(), (sen::vector<int32_t>{1, 0}));
+    EXPECT_TRUE(sen::InputJoypadUdev::Rumble(haptics, 100, 0, 50, 300 * ms));
+    EXPECT_TRUE(sen::InputJoypadUdev::Rumble(haptics, 0, 0, 0, 400 * ms));
+    EXPECT_EQ(played(), sen::vector<int32_t>{1});
+    EXPECT_EQ(uploads, 4u);
+  }
+  close(fds[0]);
+}
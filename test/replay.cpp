@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+
+#include <tuple>
+#include "common.hpp"
+#include "input.hpp"
+#include "hid.h"
+#include "pipe.hpp"
+
+namespace {
+
+using Change = std::tuple<uint64_t, uint, uint, int16_t, int16_t, uint64_t>;
+
+auto Collect(sen::Input &input, sen::vector<Change> &changes) -> void {
+  input.OnChangeBatch([&](const sen::InputChange *data, size_t count) {
+    for (size_t n = 0; n < count; ++n) {
+      auto &change = data[n];
+      changes.emplace_back(change.device->GetID(), change.group, change.input,
+                           change.old_value, change.new_value, change.timestamp);
+    }
+  });
+}
+
+}
+
+TEST(ReplayTest, ReplaysRecordedChangesExactly) {
+  auto path = testing::TempDir() + "input-replay.log";
+  sen::vector<Change> recorded;
+  size_t devices_before_removal = 0;
+  {
+    PipeInput input;
+    auto &driver = input.Install(2);
+    Collect(input, recorded);
+    ASSERT_TRUE(input.Record(path));
+
+    sen::vector<sen::shared_ptr<sen::HID::Device>> devices;
+    for (uint n = 0; n < 64; ++n) {
+      uint64_t time = 1'000'000'000 + n * 1'000'000;
+      driver.Inject(n % 2, EV_ABS, ABS_X, int(n * 977 % 65536) - 32768, time);
+      driver.Inject(n % 2, EV_KEY, BTN_SOUTH, n / 2 & 1, time + 1'000);
+      input.Poll(devices);
+    }
+    devices_before_removal = devices.size();
+    driver.Remove(1);
+    input.Poll(devices);
+    EXPECT_EQ(devices.size(), 1u);
+    ASSERT_TRUE(input.Record(""));
+  }
+  ASSERT_EQ(devices_before_removal, 2u);
+  ASSERT_FALSE(recorded.empty());
+
+  sen::Input replay;
+  ASSERT_TRUE(replay.Create("Replay"));
+  ASSERT_TRUE(replay.Replay(path));
+  sen::vector<Change> replayed;
+  Collect(replay, replayed);
+
+  sen::vector<sen::shared_ptr<sen::HID::Device>> devices;
+  replay.Poll(devices);
+  EXPECT_EQ(devices.size(), 2u);  //stops before the removal so it can be observed
+  replay.Poll(devices);
+  EXPECT_EQ(devices.size(), 1u);
+  EXPECT_EQ(replayed, recorded);
+}
+
+TEST(ReplayTest, RecordingIsWrittenOnEveryPoll) {
+  auto path = testing::TempDir() + "input-flush.log";
+  PipeInput input;
+  auto &driver = input.Install(1);
+  ASSERT_TRUE(input.Record(path));
+  auto size = [&] {
+    struct stat st{};
+    return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+  };
+
+  driver.Inject(0, EV_KEY, BTN_SOUTH, 1);
+  input.Poll();
+  auto first = size();
+  EXPECT_GT(first, 0);
+  driver.Inject(0, EV_KEY, BTN_SOUTH, 0);
+  input.Poll();
+  EXPECT_GT(size(), first);
+  ASSERT_TRUE(input.Record(""));
+}
+
+TEST(ReplayTest, AnotherReplayReplacesTheDevices) {
+  //records count joypads with buttons buttons each, pressing the last button of every one
+  auto record = [](const sen::string &path, uint count, uint buttons) {
+    PipeInput input;
+    auto &driver = input.Install(count, buttons);
+    if (!input.Record(path)) return false;
+    for (uint device = 0; device < count; ++device) driver.Inject(device, EV_KEY, BTN_TRIGGER_HAPPY1 + buttons - 2, 1);
+    input.Poll();
+    return input.Record("");
+  };
+  auto first = testing::TempDir() + "input-replay-first.log";
+  auto second = testing::TempDir() + "input-replay-second.log";
+  ASSERT_TRUE(record(first, 2, 4));
+  ASSERT_TRUE(record(second, 1, 8));
+
+  sen::Input replay;
+  ASSERT_TRUE(replay.Create("Replay"));
+  sen::vector<Change> replayed;
+  Collect(replay, replayed);
+  sen::vector<sen::shared_ptr<sen::HID::Device>> devices;
+  ASSERT_TRUE(replay.Replay(first));
+  replay.Poll(devices);
+  ASSERT_EQ(devices.size(), 2u);
+  EXPECT_EQ(replayed.size(), 2u);
+
+  replayed.clear();
+  ASSERT_TRUE(replay.Replay(second));
+  replay.Poll(devices);
+  ASSERT_EQ(devices.size(), 1u);
+  EXPECT_EQ(devices[0]->GetGroup(sen::HID::Joypad::GroupID::Button).size(), 8u);
+  ASSERT_EQ(replayed.size(), 1u);
+  EXPECT_EQ(std::get<2>(replayed[0]), 7u);
+}
+
+TEST(ReplayTest, RejectsForeignFiles) {
+  auto path = testing::TempDir() + "input-replay-foreign.log";
+  FILE *file = fopen(path.c_str(), "wb");
+  ASSERT_NE(file, nullptr);
+  fputs("definitely not a capture", file);
+  fclose(file);
+
+  sen::Input replay;
+  ASSERT_TRUE(replay.Create("Replay"));
+  EXPECT_FALSE(replay.Replay(path));
+  EXPECT_FALSE(replay.Replay(path + ".missing"));
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include "common.hpp"
+#include "input.hpp"
+#include "hid.h"
+#include "pipe.hpp"
+
+using Joypad = sen::HID::Joypad;
+
+TEST(SubscribeTest, ListenersOnlySeeMatchingChanges) {
+  PipeInput input;
+  auto &driver = input.Install(2);
+  sen::vector<sen::shared_ptr<sen::HID::Device>> devices;
+  input.Poll(devices);
+
+  uint all = 0, buttons = 0, second = 0, y = 0, keyboards = 0;
+  input.Subscribe({}, [&](const sen::InputChange &) { all++; });
+  input.Subscribe({sen::InputFilter::Joypad, {}, Joypad::GroupID::Button, 0, 0xffff}, [&](const sen::InputChange &change) {
+    EXPECT_EQ(change.group, uint(Joypad::GroupID::Button));
+    buttons++;
+  });
+  input.Subscribe({sen::InputFilter::Any, devices[1]->GetHandle(), ~0u, 0, 0xffff}, [&](const sen::InputChange &change) {
+    EXPECT_EQ(change.handle, devices[1]->GetHandle());
+    second++;
+  });
+  auto axis = input.Subscribe({sen::InputFilter::Any, {}, Joypad::GroupID::Axis, 1, 1}, [&](const sen::InputChange &change) {
+    EXPECT_EQ(change.input, 1u);
+    y++;
+  });
+  input.Subscribe({sen::InputFilter::Keyboard | sen::InputFilter::Mouse, {}, ~0u, 0, 0xffff}, [&](const sen::InputChange &) { keyboards++; });
+
+  driver.Inject(0, EV_KEY, BTN_SOUTH, 1);
+  driver.Inject(0, EV_ABS, ABS_X, 100);
+  driver.Inject(0, EV_ABS, ABS_Y, 100);
+  driver.Inject(1, EV_KEY, BTN_SOUTH, 1);
+  driver.Inject(1, EV_ABS, ABS_Y, 200);
+  input.Poll(devices);
+  EXPECT_EQ(all, 5u);
+  EXPECT_EQ(buttons, 2u);
+  EXPECT_EQ(second, 2u);
+  EXPECT_EQ(y, 2u);
+  EXPECT_EQ(keyboards, 0u);
+
+  EXPECT_TRUE(input.Unsubscribe(axis));
+  EXPECT_FALSE(input.Unsubscribe(axis));
+  driver.Inject(0, EV_ABS, ABS_Y, 300);
+  input.Poll(devices);
+  EXPECT_EQ(all, 6u);
+  EXPECT_EQ(y, 2u);
+
+  //the routes of a removed device are dropped
+  driver.Remove(1);
+  input.Poll(devices);
+  ASSERT_EQ(devices.size(), 1u);
+  driver.Inject(0, EV_KEY, BTN_SOUTH, 0);
+  input.Poll(devices);
+  EXPECT_EQ(all, 7u);
+  EXPECT_EQ(second, 2u);
+}
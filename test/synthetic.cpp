@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <chrono>
+#include "common.hpp"
+#include "input.hpp"
+#include "hid.h"
+
+TEST(SyntheticTest, GeneratesChangesAtTheConfiguredRate) {
+  sen::Input input;
+  ASSERT_TRUE(input.Create("Synthetic"));
+
+  sen::InputSimulation slow;
+  slow.rate = 125;
+  sen::InputSimulation fast;
+  fast.axes = 2;
+  fast.hats = 0;
+  fast.buttons = 4;
+  fast.rate = 8000;
+  ASSERT_TRUE(input.Simulate({slow, fast}));
+
+  std::map<sen::HID::Device *, uint64_t> changes;
+  input.OnChangeBatch([&](const sen::InputChange *data, size_t count) {
+    for (size_t n = 0; n < count; ++n) changes[data[n].device]++;
+  });
+
+  sen::vector<sen::shared_ptr<sen::HID::Device>> devices;
+  input.Poll(devices);
+  ASSERT_EQ(devices.size(), 2u);
+  EXPECT_TRUE(devices[0]->IsJoypad());
+  EXPECT_EQ(devices[1]->GetGroup(sen::HID::Joypad::GroupID::Axis).size(), 2u);
+  EXPECT_EQ(devices[1]->GetGroup(sen::HID::Joypad::GroupID::Button).size(), 4u);
+
+  auto start = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(200)) {
+    input.Poll(devices);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  EXPECT_GT(changes[devices[0].get()], 0u);
+  EXPECT_GT(changes[devices[1].get()], changes[devices[0].get()] * 8);
+}
+
+TEST(SyntheticTest, RejectsImpossibleLayouts) {
+  sen::Input input;
+  ASSERT_TRUE(input.Create("Synthetic"));
+  sen::InputSimulation simulation;
+  sen::InputSimulation impossible;
+  impossible.axes = 64;
+  EXPECT_FALSE(input.Simulate({impossible}));
+
+  //the devices already simulated survive a rejected layout
+  ASSERT_TRUE(input.Simulate({simulation, simulation}));
+  auto devices = input.Poll();
+  ASSERT_EQ(devices.size(), 2u);
+  EXPECT_FALSE(input.Simulate({simulation, impossible}));
+  EXPECT_EQ(input.Poll(), devices);
+}
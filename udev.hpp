@@ -8,20 +8,22 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
 #include <libudev.h>
 #include <linux/types.h>
 #include <linux/input.h>
 
-#include "keyboard/xlib.hpp"
-#include "mouse/xlib.hpp"
+#include "keyboard/udev.hpp"
+#include "mouse/udev.hpp"
 #include "joypad/udev.hpp"
 
 namespace sen {
 
 struct InputUdev : InputDriver {
   InputUdev &self = *this;
-  explicit InputUdev(Input &super) : InputDriver(super)/*, keyboard(super), mouse(super)*/, joypad(super) {}
+  explicit InputUdev(Input &super) : InputDriver(super), keyboard(super), mouse(super), joypad(super) {}
   ~InputUdev() override { Terminate(); }
 
   auto Create() -> bool override {
@@ -35,42 +37,182 @@ struct InputUdev : InputDriver {
 
   auto SetContext(uintptr context) -> bool override { return Initialize(); }
 
-  // auto Acquired() -> bool override { return mouse.acquired(); }
-  // auto Acquire() -> bool override { return mouse.acquire(); }
-  // auto Release() -> bool override { return mouse.release(); }
+  auto HasThreaded() -> bool override { return true; }
 
-  auto Poll() -> vector<shared_ptr<HID::Device>> override {
-    vector<shared_ptr<HID::Device>> devices;
-    // keyboard.poll(devices);
-    // mouse.poll(devices);
-    joypad.Poll(devices);
-    return devices;
+  auto SetThreaded(bool threaded) -> bool override {
+    if (!isReady) return true;  //applied by Initialize()
+    if (!joypad.SetThreaded(threaded)) return false;
+    Nest();
+    return true;
   }
 
-  auto Rumble(uint64_t id, bool enable) -> bool override {
-    return joypad.Rumble(id, enable);
+  auto HasCoalesced() -> bool override { return true; }
+
+  auto SetCoalesced(bool coalesced) -> bool override {
+    return joypad.SetCoalesced(coalesced);
+  }
+
+  auto HasMotionHistory() -> bool override { return true; }
+
+  auto SetMotionHistory(uint samples) -> bool override {
+    return mouse.SetMotionHistory(samples);
+  }
+
+  auto Motion(vector<InputMotion> &samples) -> void override { mouse.Motion(samples); }
+
+  auto Acquired() -> bool override { return mouse.Acquired(); }
+  auto Acquire() -> bool override { return mouse.Acquire(); }
+  auto Release() -> bool override { return mouse.Release(); }
+
+  //one epoll_wait tells which backends have events: the keyboard, mouse and joypad
+  //sets are nested in epoll, except the joypad set while the input thread waits on it.
+  //the backend generations only ever grow, so their sum moves whenever any does
+  auto Poll(vector<shared_ptr<HID::Device>> &devices) -> void override {
+    bool keyboards = false, mice = false, joypads = joypad.threaded;
+    if (epoll >= 0) {
+      epoll_event ready[Backends];
+      int count = epoll_wait(epoll, ready, Backends, 0);
+      for (int n = 0; n < count; ++n) {
+        if (ready[n].data.u64 == KeyboardTag) keyboards = true;
+        if (ready[n].data.u64 == MouseTag) mice = true;
+        if (ready[n].data.u64 == JoypadTag) joypads = true;
+      }
+    }
+    if (joypads) joypad.Poll();
+    Hotplug();
+    if (keyboards) keyboard.Poll();
+    mouse.Poll(mice);
+    Publish(devices, keyboard.generation + mouse.generation + joypad.generation, [&](auto &list) {
+      keyboard.Devices(list);
+      mouse.Devices(list);
+      joypad.Devices(list);
+    });
+  }
+
+  auto Rumble(uint64_t id, uint16_t strong, uint16_t weak, uint16_t duration) -> bool override {
+    return joypad.Rumble(id, strong, weak, duration);
+  }
+
+  auto Rumble(Handle handle, uint16_t strong, uint16_t weak, uint16_t duration) -> bool override {
+    return joypad.Rumble(handle, strong, weak, duration);
+  }
+
+  auto Statistics(uint64_t id) -> InputStatistics override {
+    return joypad.Statistics(id);
+  }
+
+  auto Statistics(Handle handle) -> InputStatistics override {
+    return joypad.Statistics(handle);
+  }
+
+  auto Resync() -> void override {
+    keyboard.Resync();
+    mouse.Resync();
+    joypad.Resync();
+  }
+
+  auto Record(const string &path) -> bool override {
+    return joypad.Record(path);
+  }
+
+  //call before SetContext() so that the initial device scan can use it
+  auto Cache(const string &path) -> bool override {
+    return joypad.Cache(path);
   }
 
  private:
+  enum : uint64_t { KeyboardTag, MouseTag, JoypadTag, Backends };
+
+  //the joypad backend owns the udev context and the one monitor; the other
+  //backends enumerate through its context and are told about their devices
   auto Initialize() -> bool {
     Terminate();
     if (!self.context_) return false;
-    // if (!keyboard.initialize()) return false;
-    // if (!mouse.initialize(self.context_)) return false;
+    epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll < 0) return false;
+    joypad.hotplug = [this](udev_device *device) { Queue(device); };
     if (!joypad.Initialize()) return false;
+    if (!keyboard.Initialize(joypad.context)) return false;
+    if (!mouse.Initialize(joypad.context)) return false;
+    if (!mouse.SetMotionHistory(self.motion_history_)) return false;
+    if (!joypad.SetThreaded(self.threaded_)) return false;
+    Watch(keyboard.epoll, KeyboardTag);
+    Watch(mouse.epoll, MouseTag);
+    Nest();
     return isReady = true;
   }
 
   auto Terminate() -> void {
     isReady = false;
-    // keyboard.terminate();
-    // mouse.terminate();
+    keyboard.Terminate();
+    mouse.Terminate();
     joypad.Terminate();
+    joypad.hotplug = nullptr;
+    hotplugs.clear();
+    nested = false;
+    if (epoll >= 0) {
+      close(epoll);
+      epoll = -1;
+    }
+  }
+
+  auto Watch(int fd, uint64_t tag) -> void {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = tag;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
   }
 
+  //the joypad set is only nested while Poll() reads it
+  auto Nest() -> void {
+    if (nested == !joypad.threaded) return;
+    nested = !joypad.threaded;
+    if (nested) Watch(joypad.epoll, JoypadTag);
+    else epoll_ctl(epoll, EPOLL_CTL_DEL, joypad.epoll, nullptr);
+  }
+
+  //called by the joypad backend, possibly on its input thread
+  auto Queue(udev_device *device) -> void {
+    auto property = [&](const char *name) {
+      const char *value = udev_device_get_property_value(device, name);
+      return value && string(value) == "1";
+    };
+    bool isKeyboard = property("ID_INPUT_KEYBOARD");
+    bool isMouse = property("ID_INPUT_MOUSE");
+    if (!isKeyboard && !isMouse) return;
+    std::lock_guard<std::mutex> guard(hotplugLock);
+    hotplugs.push_back({udev_device_get_action(device), udev_device_get_devnode(device), isKeyboard, isMouse});
+  }
+
+  //applies the queued hotplug events on the polling thread
+  auto Hotplug() -> void {
+    {
+      std::lock_guard<std::mutex> guard(hotplugLock);
+      if (hotplugs.empty()) return;
+      std::swap(hotplugs, applying);
+    }
+    for (auto &event : applying) {
+      if (event.keyboard) keyboard.Hotplug(event.action, event.deviceNode);
+      if (event.mouse) mouse.Hotplug(event.action, event.deviceNode);
+    }
+    applying.clear();
+  }
+
+  struct HotplugEvent {
+    string action;
+    string deviceNode;
+    bool keyboard;
+    bool mouse;
+  };
+
   bool isReady = false;
-  // InputKeyboardXlib keyboard{};
-  // InputMouseXlib mouse{};
+  int epoll = -1;
+  bool nested = false;
+  std::mutex hotplugLock;
+  vector<HotplugEvent> hotplugs;
+  vector<HotplugEvent> applying;
+  InputKeyboardUdev keyboard;
+  InputMouseUdev mouse;
   InputJoypadUdev joypad;
 };
 
@@ -36,18 +36,17 @@ struct InputWindows : InputDriver {
   // auto Acquire() -> bool override { return mouse.acquire(); }
   // auto Release() -> bool override { return mouse.release(); }
 
-  auto Poll() -> vector<shared_ptr<HID::Device>> override {
-    vector<shared_ptr<HID::Device>> devices;
+  auto Poll(vector<shared_ptr<HID::Device>> &devices) -> void override {
+    devices.clear();
     // keyboard.poll(devices);
     // mouse.poll(devices);
     // joypadXInput.poll(devices);
     // joypadDirectInput.poll(devices);
-    return devices;
   }
 
-  auto Rumble(uint64_t id, bool enable) -> bool override {
-    // if(joypadXInput.rumble(id, enable)) return true;
-    // if(joypadDirectInput.rumble(id, enable)) return true;
+  auto Rumble(uint64_t id, uint16_t strong, uint16_t weak, uint16_t duration) -> bool override {
+    // if(joypadXInput.rumble(id, strong || weak)) return true;
+    // if(joypadDirectInput.rumble(id, strong || weak)) return true;
     return false;
   }
 